@@ -1,6 +1,15 @@
+#include <library/m99/m99_async_writer.h>
+#include <library/m99/m99_bounded_queue.h>
+#include <library/m99/m99_buffer_pool.h>
+#include <library/m99/m99_crc32c.h>
 #include <library/m99/m99_encode.h>
 #include <library/m99/m99_decode.h>
+#include <library/m99/m99_frame.h>
+#include <library/m99/m99_inverse_bwt.h>
+#include <library/m99/m99_mapped_file.h>
+#include <library/m99/m99_thread_pool.h>
 #include <library/msufsort.h>
+#include <algorithm>
 #include <cstdint>
 #include <iostream>
 #include <memory>
@@ -13,19 +22,210 @@
 #include <atomic>
 #include <mutex>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 
 namespace
 {
 
-    static auto constexpr max_encode_block_size = (1ull << 20);
+    // bounds for the sub block size.  each block is encoded as a sequence of independent sub blocks of this size
+    // (the last may be shorter).  the size is recorded per block.  the frame format sets the lower bound.
+    static auto constexpr min_sub_block_size = (std::uint64_t)maniscalco::m99_min_sub_block_size;
+    static auto constexpr max_sub_block_size = (1ull << 24);
+
+    // the adaptive sub block size is reduced until a block has at least this many sub blocks so that the sub blocks
+    // of even a small block can be spread across threads (about four each for sixteen threads).  this is fixed
+    // rather than derived from the thread count so that the output is identical for any number of threads.
+    static auto constexpr parallel_sub_block_count = 64;
+
+    // an encoded sub block.  the encoded data lives at the end of the buffer and is held until every sub block of the
+    // block is encoded because the block's index (which precedes the data) needs all of the encoded sizes.
+    struct encoded_sub_block
+    {
+        maniscalco::m99_buffer_pool::buffer_type buffer_;
+        std::uint8_t const * data_{nullptr};
+        std::uint32_t size_{0};
+        std::uint32_t checksum_{0};
+    };
+
+    // a block as it moves through the stages of the encoder.  it is read into 'data_' (or lies within a private
+    // mapping of the input) and is then transformed (BWT) in place.
+    struct encoder_block
+    {
+        maniscalco::m99_buffer_pool::buffer_type data_;
+        std::uint8_t * begin_{nullptr};     // data_ or the block within the mapped input
+        std::size_t size_{0};
+        std::uint32_t sentinelIndex_{0};
+        std::uint32_t subBlockSize_{0};
+        std::uint32_t checksum_{0};
+    };
+
+    // number of blocks which may wait between two stages of the pipelined encoder.  together with the block
+    // in each stage this bounds the number of blocks in memory.  zero hands each block directly from one stage
+    // to the next so only the three blocks being read, transformed and coded are held.  the stages still overlap
+    // since each starts on its next block as soon as the following stage has taken its last.
+    static auto constexpr encoder_pipeline_depth = 0;
+
+    // a block as it moves through the stages of the decoder
+    struct decoder_block
+    {
+        maniscalco::m99_encoded_block encoded_;
+        maniscalco::m99_decoded_block decoded_;
+        maniscalco::m99_buffer_pool::buffer_type output_;
+        std::uint8_t * outputData_{nullptr};    // output_ or the block's place within the mapped output
+    };
+
+    // number of blocks which may wait between two stages of the pipelined decoder.  as for the encoder, zero
+    // hands each block directly between the stages so only the four blocks being worked on are held.
+    static auto constexpr decoder_pipeline_depth = 0;
+
+    // "-" in place of a path is stdin or stdout.  these are only ever read or written sequentially.
+    static auto constexpr standard_stream_path = "-";
+
+    // stdout itself (set by main).  when the output is stdout then std::cout is redirected to stderr so that
+    // messages do not become part of the output.
+    std::streambuf * standard_output = nullptr;
+
+
+    //==================================================================================================================
+    bool is_standard_stream
+    (
+        char const * path
+    )
+    {
+        return (std::strcmp(path, standard_stream_path) == 0);
+    }
+
+
+    //==================================================================================================================
+    std::unique_ptr<std::istream> open_input_stream
+    (
+        char const * path
+    )
+    {
+        if (is_standard_stream(path))
+            return std::make_unique<std::istream>(std::cin.rdbuf());
+        auto inputStream = std::make_unique<std::ifstream>(path, std::ios_base::in | std::ios_base::binary);
+        if (!inputStream->is_open())
+        {
+            std::cout << "failed to open file \"" << path << "\"" << std::endl;
+            return nullptr;
+        }
+        return inputStream;
+    }
+
+
+    //==================================================================================================================
+    std::unique_ptr<std::ostream> open_output_stream
+    (
+        char const * path
+    )
+    {
+        if (is_standard_stream(path))
+            return std::make_unique<std::ostream>(standard_output);
+        auto outStream = std::make_unique<std::ofstream>(path, std::ios_base::out | std::ios_base::binary);
+        if (!outStream->is_open())
+        {
+            std::cout << "failed to create output file \"" << path << "\"" << std::endl;
+            return nullptr;
+        }
+        return outStream;
+    }
+
 
-    struct block_header
+    // the input of the decoder.  either a stream or a mapped file whose blocks are decoded in place.
+    struct decoder_input
     {
-        std::uint32_t blockSize_;
-        std::uint32_t sentinelIndex_;
+        std::unique_ptr<std::istream> stream_;
+        maniscalco::m99_mapped_file file_;
+        std::uint8_t const * current_{nullptr};
+        std::uint8_t const * end_{nullptr};
+        maniscalco::m99_frame_limits limits_;   // from the frame header and the length of the input (if known)
     };
 
 
+    //==================================================================================================================
+    bool open_decoder_input
+    (
+        // opens the input, mapping it if requested and possible (a pipe can not be mapped), reads and validates
+        // the frame header and sets the limits which the blocks which follow must respect
+        char const * path,
+        bool useMemoryMapping,
+        decoder_input & input
+    )
+    {
+        maniscalco::m99_frame_header frameHeader;
+        bool haveFrameHeader = false;
+        if (useMemoryMapping && (!is_standard_stream(path)) && input.file_.open(path, maniscalco::m99_mapped_file::access_type::read_only))
+        {
+            input.file_.advise_sequential();
+            input.current_ = input.file_.data();
+            input.end_ = (input.current_ + input.file_.size());
+            haveFrameHeader = (input.file_.size() >= sizeof(frameHeader));
+            if (haveFrameHeader)
+            {
+                std::memcpy((void *)&frameHeader, input.current_, sizeof(frameHeader));
+                input.current_ += sizeof(frameHeader);
+            }
+        }
+        else
+        {
+            input.stream_ = open_input_stream(path);
+            if (!input.stream_)
+                return false;
+            haveFrameHeader = (bool)input.stream_->read((char *)&frameHeader, sizeof(frameHeader));
+            // the length of a file (but not of a pipe) limits what its blocks may claim
+            if (haveFrameHeader && (!is_standard_stream(path)))
+            {
+                std::uint64_t position = input.stream_->tellg();
+                input.stream_->seekg(0, std::ios_base::end);
+                std::uint64_t size = input.stream_->tellg();
+                input.stream_->seekg(position, std::ios_base::beg);
+                input.limits_.bytesRemaining_ = (size - position);
+            }
+        }
+        if (!haveFrameHeader || !maniscalco::m99_is_valid(frameHeader))
+        {
+            std::cout << "\"" << path << "\" is not an m99 file or is of an unsupported version" << std::endl;
+            return false;
+        }
+        input.limits_.maxBlockSize_ = frameHeader.maxBlockSize_;
+        return true;
+    }
+
+
+    //==================================================================================================================
+    bool read_block
+    (
+        // reads the next block of the input (see m99_read_block).  the blocks of a mapped input are not copied.
+        decoder_input & input,
+        maniscalco::m99_encoded_block & encodedBlock,
+        maniscalco::m99_buffer_pool & bufferPool
+    )
+    {
+        if (input.stream_)
+            return maniscalco::m99_read_block(*input.stream_, input.limits_, encodedBlock, bufferPool);
+        return maniscalco::m99_view_block(input.current_, input.end_, input.limits_.maxBlockSize_, encodedBlock);
+    }
+
+
+    //==================================================================================================================
+    int open_output_file
+    (
+        // opens the output for the asynchronous writer which writes to the descriptor directly.  returns -1 on failure.
+        char const * path
+    )
+    {
+        if (is_standard_stream(path))
+            return STDOUT_FILENO;
+        auto fileDescriptor = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fileDescriptor < 0)
+            std::cout << "failed to create output file \"" << path << "\"" << std::endl;
+        return fileDescriptor;
+    }
+
+
     //==================================================================================================================
     std::vector<char> load_file
     (
@@ -52,232 +252,173 @@ namespace
 
 
     //==================================================================================================================
-    void encode_block
+    std::uint32_t choose_sub_block_size
     (
-        // single threaded
-        std::uint8_t const * inputBegin,
-        std::uint8_t const * inputEnd,
-        std::ofstream & outStream
+        // adaptive sub block size policy.  the cost of a sub block's header grows with the number of distinct symbols
+        // so large alphabets want larger sub blocks while very small alphabets compress slightly better with smaller
+        // sub blocks which track local statistics more closely.  beyond 1MB there is no measurable gain for any
+        // alphabet.  within those limits the size is reduced so that the block has enough sub blocks to share
+        // between threads.  the choice depends only on the data so the output does not depend on the thread count.
+        std::uint8_t const * begin,
+        std::uint8_t const * end
     )
     {
-        // transform input (BWT)
-        auto sentinelIndex = maniscalco::forward_burrows_wheeler_transform(inputBegin, inputEnd, 1);
+        static auto constexpr max_sample_size = (1ull << 16);
+        std::size_t blockSize = std::distance(begin, end);
 
-        // write header for input
-        block_header blockHeader
+        // estimate the alphabet size from an evenly spaced sample of the block
+        bool seen[256] = {};
+        std::uint32_t alphabetSize = 0;
+        auto stride = std::max<std::size_t>(blockSize / max_sample_size, 1);
+        for (auto current = begin; current < end; current += stride)
         {
-            .blockSize_ = std::distance(inputBegin, inputEnd),
-            .sentinelIndex_ = sentinelIndex
-        };
-        outStream.write((char const *)&blockHeader, sizeof(blockHeader));
-
-        std::uint32_t subBlockId{0};
-        // encode next available sub block until there are none remaining
-        std::uint32_t currentSubBlockId = subBlockId++;
-        auto blockBegin = inputBegin + (currentSubBlockId * max_encode_block_size);
-        while (blockBegin < inputEnd)
-        {
-            auto blockEnd = (blockBegin + max_encode_block_size);
-            if (blockEnd > inputEnd)
-                blockEnd = inputEnd;
-            // create encode stream and encode this subblock
-            maniscalco::m99_encode_stream encodeStream;
-            maniscalco::m99_encode(blockBegin, blockEnd, encodeStream);
-            encodeStream.flush();
-            // write this encoded sub block to the destination
-            auto encodedSize = ((encodeStream.size() + 7) / 8);
-            outStream.write((char const *)&encodedSize, 4);
-            outStream.write((char const *)&currentSubBlockId, 4);
-            // write the encoded data for the stream
-            for (auto const & packet : encodeStream)
-            {
-                auto bytesToWrite = ((packet.size() + 7) / 8);
-                auto address = (packet.data() + packet.capacity() - bytesToWrite);
-                outStream.write((char const *)address, bytesToWrite);
-            }
-            currentSubBlockId = subBlockId++;
-            blockBegin = inputBegin + (currentSubBlockId * max_encode_block_size);
+            alphabetSize += !seen[*current];
+            seen[*current] = true;
         }
-    }
 
+        std::uint64_t smallest = min_sub_block_size;
+        while (smallest < (alphabetSize * (1ull << 11)))
+            smallest <<= 1;
+        std::uint64_t subBlockSize = (alphabetSize <= 16) ? (1ull << 18) : (1ull << 20);
+        while ((subBlockSize > smallest) && ((blockSize / subBlockSize) < parallel_sub_block_count))
+            subBlockSize >>= 1;
+        return std::max(subBlockSize, smallest);
+    }
 
 
     //==================================================================================================================
-    void encode_block
+    void encode_sub_block
     (
-        std::uint8_t const * inputBegin,
-        std::uint8_t const * inputEnd,
-        std::ofstream & outStream,
-        std::size_t numThreads
+        std::uint8_t const * begin,
+        std::uint8_t const * end,
+        encoded_sub_block & encodedSubBlock,
+        maniscalco::m99_encode_options const & encodeOptions,
+        bool useChecksums,
+        maniscalco::m99_buffer_pool & bufferPool
     )
     {
-        // transform input (BWT)
-        auto sentinelIndex = maniscalco::forward_burrows_wheeler_transform(inputBegin, inputEnd, numThreads);
-
-        // write header for input
-        block_header blockHeader
-        {
-            .blockSize_ = std::distance(inputBegin, inputEnd),
-            .sentinelIndex_ = sentinelIndex
-        };
-        outStream.write((char const *)&blockHeader, sizeof(blockHeader));
-
-        // create worker threads for encoding
-        std::vector<std::thread> threads;
-        threads.resize(numThreads);
-        
-        // set threads to process sub blocks of the input
-        std::atomic<std::uint32_t> subBlockId{0};
-        std::mutex mutex;
-        for (auto & thread : threads)
-        {
-            thread = std::thread([&]()
-            {
-                // encode next available sub block until there are none remaining
-                std::uint32_t currentSubBlockId = subBlockId++;
-                auto blockBegin = inputBegin + (currentSubBlockId * max_encode_block_size);
-                while (blockBegin < inputEnd)
-                {
-                    auto blockEnd = (blockBegin + max_encode_block_size);
-                    if (blockEnd > inputEnd)
-                        blockEnd = inputEnd;
-                    // create encode stream and encode this subblock
-                    maniscalco::m99_encode_stream encodeStream;
-                    maniscalco::m99_encode(blockBegin, blockEnd, encodeStream);
-                    encodeStream.flush();
-                    // write this encoded sub block to the destination
-                    std::lock_guard lockGuard(mutex);
-                    auto encodedSize = ((encodeStream.size() + 7) / 8);
-                    outStream.write((char const *)&encodedSize, 4);
-                    outStream.write((char const *)&currentSubBlockId, 4);
-                    // write the encoded data for the stream
-                    for (auto const & packet : encodeStream)
-                    {
-                        auto bytesToWrite = ((packet.size() + 7) / 8);
-                        auto address = (packet.data() + packet.capacity() - bytesToWrite);
-                        outStream.write((char const *)address, bytesToWrite);
-                    }
-                    currentSubBlockId = subBlockId++;
-                    blockBegin = inputBegin + (currentSubBlockId * max_encode_block_size);
-                }
-            });
-        }
-        // wait for threads to complete encoding
-        for (auto & thread : threads)
-            thread.join();
+        encodedSubBlock.buffer_ = bufferPool.acquire(maniscalco::m99_encode_bound(std::distance(begin, end), encodeOptions));
+        maniscalco::m99_encode_stream encodeStream(encodedSubBlock.buffer_.data(), encodedSubBlock.buffer_.data() + encodedSubBlock.buffer_.size());
+        maniscalco::m99_encode(begin, end, encodeStream, encodeOptions);
+        encodeStream.flush();
+        encodedSubBlock.data_ = encodeStream.data();
+        encodedSubBlock.size_ = ((encodeStream.size() + 7) / 8);
+        if (useChecksums)
+            encodedSubBlock.checksum_ = maniscalco::m99_crc32c(encodedSubBlock.data_, encodedSubBlock.size_);
     }
 
 
     //==================================================================================================================
-    void decode_block
+    std::size_t write_block
     (
-        std::ifstream & inStream,
-        std::ofstream & outStream,
-        std::uint32_t numThreads
+        // queues the block header, the sub block index, the checksums (if any) and then the encoded sub blocks as a
+        // single write.  the sub blocks are written directly from their buffers which are handed to the writer and
+        // released once written.  returns the number of bytes written or zero if the writer has failed.
+        maniscalco::m99_async_writer & writer,
+        std::uint32_t blockSize,
+        std::uint32_t subBlockSize,
+        std::uint32_t sentinelIndex,
+        maniscalco::m99_encode_options const & encodeOptions,
+        bool useChecksums,
+        std::uint32_t blockChecksum,
+        std::vector<encoded_sub_block> & encodedSubBlocks
     )
     {
-        // read header for block
-        block_header blockHeader;
-        inStream.read((char *)&blockHeader, sizeof(blockHeader));
-        std::uint32_t bytesPerSubBlock = ((blockHeader.blockSize_ + numThreads - 1) / numThreads);
-
-        // allocate space for decoded block data
-        std::vector<std::uint8_t> output;
-        output.resize(blockHeader.blockSize_);
-        auto outputBegin = output.data();
-        auto outputEnd = (outputBegin + output.size());
+        maniscalco::m99_block_header blockHeader
+        {
+            .blockSize_ = blockSize,
+            .subBlockSize_ = subBlockSize,
+            .sentinelIndex_ = sentinelIndex,
+            .subBlockCount_ = (std::uint32_t)encodedSubBlocks.size(),
+            .flags_ = (std::uint16_t)((encodeOptions.adaptiveCoding_ ? maniscalco::m99_block_flag_adaptive_coding : 0) |
+                    (useChecksums ? maniscalco::m99_block_flag_checksums : 0)),
+            .splitDepth_ = (std::uint16_t)encodeOptions.splitDepth_
+        };
+        maniscalco::m99_async_writer::request_type request;
+        auto append = [&](void const * data, std::size_t size)
+                {
+                    request.head_.insert(request.head_.end(), (std::uint8_t const *)data, (std::uint8_t const *)data + size);
+                };
+        append(&blockHeader, sizeof(blockHeader));
 
-        // create decode threads
-        std::vector<std::thread> threads;
-        threads.resize(numThreads - 1);
+        std::vector<maniscalco::m99_sub_block_index_entry> index(encodedSubBlocks.size());
+        for (std::size_t i = 0; i < encodedSubBlocks.size(); ++i)
+            index[i].encodedSize_ = encodedSubBlocks[i].size_;
+        append(index.data(), index.size() * sizeof(maniscalco::m99_sub_block_index_entry));
 
-        std::atomic<std::uint32_t> numSubBlocksToDecode((blockHeader.blockSize_ + max_encode_block_size - 1) / max_encode_block_size);
-        auto n = numSubBlocksToDecode.load();
+        if (useChecksums)
+        {
+            std::vector<maniscalco::m99_checksum> checksums(encodedSubBlocks.size() + 1);
+            for (std::size_t i = 0; i < encodedSubBlocks.size(); ++i)
+                checksums[i] = encodedSubBlocks[i].checksum_;
+            checksums.back() = blockChecksum;
+            append(checksums.data(), checksums.size() * sizeof(maniscalco::m99_checksum));
+        }
 
-        std::mutex mutex;
-        for (auto & thread : threads)
+        for (auto & encodedSubBlock : encodedSubBlocks)
         {
-            thread = std::thread([&]()
-                {
-                    while (true)
-                    {
-                        maniscalco::buffer encodedData;
-                        std::uint32_t encodedSize = 0;
-                        std::uint32_t subBlockId = 0;
-                        {
-                            std::lock_guard lockGuard(mutex);
-                            if (numSubBlocksToDecode < 1)
-                                return; // no more work to do
-
-                            --numSubBlocksToDecode;
-                            // read next compress subblock from source
-                            inStream.read((char *)&encodedSize, 4);
-                            inStream.read((char *)&subBlockId, 4);
-                            // read encoded sub block data
-                            encodedData = std::move(maniscalco::buffer(encodedSize));
-                            inStream.read((char *)encodedData.data(), encodedSize);
-                        }
-                        auto destinationBegin = (outputBegin + (subBlockId * max_encode_block_size));
-                        auto destinationEnd = (destinationBegin + max_encode_block_size);
-                        if (destinationEnd > outputEnd)
-                            destinationEnd = outputEnd;
-                        maniscalco::m99_decode_stream decodeStream(std::move(encodedData), encodedSize);
-                        maniscalco::m99_decode(decodeStream, destinationBegin, destinationEnd);
-                    }
-                });
+            request.segments_.push_back({encodedSubBlock.data_, encodedSubBlock.size_});
+            request.buffers_.push_back(std::move(encodedSubBlock.buffer_));
         }
+        auto bytesWritten = request.size();
+        return writer.write(std::move(request)) ? bytesWritten : 0;
+    }
 
-        // wait for all subblocks to be decoded
-        for (auto & thread : threads)
-            thread.join();
 
-        // reverse the BWT
-        maniscalco::reverse_burrows_wheeler_transform(output.begin(), output.end(), blockHeader.sentinelIndex_, numThreads);
-        outStream.write((char const *)&*outputBegin, output.size());
+    //==================================================================================================================
+    void transform_block
+    (
+        // computes the checksum of the block (if required), transforms it (BWT) in place and chooses its
+        // sub block size (if not fixed)
+        encoder_block & block,
+        std::size_t numThreads,
+        std::uint32_t subBlockSize,
+        bool useChecksums
+    )
+    {
+        auto inputBegin = block.begin_;
+        auto inputEnd = (inputBegin + block.size_);
+        block.checksum_ = useChecksums ? maniscalco::m99_crc32c(inputBegin, block.size_) : 0;
+        block.sentinelIndex_ = maniscalco::forward_burrows_wheeler_transform(inputBegin, inputEnd, numThreads);
+        // zero selects the sub block size adaptively for each block
+        block.subBlockSize_ = (subBlockSize == 0) ? choose_sub_block_size(inputBegin, inputEnd) : subBlockSize;
     }
 
 
     //==================================================================================================================
-    void decode_block
+    std::size_t encode_transformed_block
     (
-        // single threaded
-        std::ifstream & inStream,
-        std::ofstream & outStream
+        // m99 codes the sub blocks of a transformed block in parallel and writes the block.  returns the
+        // number of bytes written or zero if the writer has failed.
+        encoder_block const & block,
+        maniscalco::m99_async_writer & writer,
+        std::size_t numThreads,
+        maniscalco::m99_encode_options encodeOptions,
+        bool useChecksums,
+        maniscalco::m99_buffer_pool & bufferPool
     )
     {
-        // read header for block
-        block_header blockHeader;
-        inStream.read((char *)&blockHeader, sizeof(blockHeader));
-        std::uint32_t bytesPerSubBlock = blockHeader.blockSize_;
-
-        // allocate space for decoded block data
-        std::vector<std::uint8_t> output;
-        output.resize(blockHeader.blockSize_);
-        auto outputBegin = output.data();
-        auto outputEnd = (outputBegin + output.size());
-
-        std::uint32_t numSubBlocksToDecode((blockHeader.blockSize_ + max_encode_block_size - 1) / max_encode_block_size);
-        while (numSubBlocksToDecode-- > 0)
-        {
-            maniscalco::buffer encodedData;
-            std::uint32_t encodedSize = 0;
-            std::uint32_t subBlockId = 0;
-            // read next compress subblock from source
-            inStream.read((char *)&encodedSize, 4);
-            inStream.read((char *)&subBlockId, 4);
-            // read encoded sub block data
-            encodedData = std::move(maniscalco::buffer(encodedSize));
-            inStream.read((char *)encodedData.data(), encodedSize);
-            auto destinationBegin = (outputBegin + (subBlockId * max_encode_block_size));
-            auto destinationEnd = (destinationBegin + max_encode_block_size);
-            if (destinationEnd > outputEnd)
-                destinationEnd = outputEnd;
-            maniscalco::m99_decode_stream decodeStream(std::move(encodedData), encodedSize);
-            maniscalco::m99_decode(decodeStream, destinationBegin, destinationEnd);
-        }
-        // reverse the BWT
-        maniscalco::reverse_burrows_wheeler_transform(output.begin(), output.end(), blockHeader.sentinelIndex_, 1);
-        outStream.write((char const *)&*outputBegin, output.size());
+        auto inputBegin = block.begin_;
+        auto inputEnd = (inputBegin + block.size_);
+        auto subBlockSize = block.subBlockSize_;
+
+        // when there are fewer sub blocks than threads the remaining threads are used to encode within
+        // each sub block instead.
+        std::size_t numSubBlocks = ((block.size_ + subBlockSize - 1) / subBlockSize);
+        std::vector<encoded_sub_block> encodedSubBlocks(numSubBlocks);
+        auto numWorkers = std::max<std::size_t>(std::min(numThreads, numSubBlocks), 1);
+        encodeOptions.numThreads_ = (numThreads / numWorkers);
+
+        // each sub block is encoded into its own slot so no synchronization is needed beyond claiming
+        // the next sub block.  the slots are written out in sub block order once all are full so the output does
+        // not depend on which thread encodes which sub block or on the order in which they finish.
+        maniscalco::m99_thread_pool::instance().parallel_for(numSubBlocks, numWorkers, [&](std::size_t subBlockId)
+                {
+                    auto subBlockBegin = inputBegin + (subBlockId * subBlockSize);
+                    auto subBlockEnd = std::min(subBlockBegin + subBlockSize, inputEnd);
+                    encode_sub_block(subBlockBegin, subBlockEnd, encodedSubBlocks[subBlockId], encodeOptions, useChecksums, bufferPool);
+                });
+        return write_block(writer, block.size_, subBlockSize, block.sentinelIndex_, encodeOptions, useChecksums, block.checksum_, encodedSubBlocks);
     }
 
 
@@ -295,62 +436,333 @@ namespace
     (
     )
     {
-        std::cout << "Usage: m99 [e|d] inputFile outputFile [switches]" << std::endl;
+        std::cout << "Usage: m99 [e|d|x] inputFile outputFile [switches]" << std::endl;
+        std::cout << "       m99 t inputFile [switches]" << std::endl;
+        std::cout << "\t e = encode, d = decode, x = extract a range of the original data, t = test (decode and verify without output)" << std::endl;
         std::cout << "\t -t = threadCount" << std::endl;
-        std::cout << "\t -b = blockSize (max = 1GB)" << std::endl; 
+        std::cout << "\t -b = blockSize (max = 1GB.  encoding holds three blocks, the BWT's working space of about four times" << std::endl; 
+        std::cout << "\t      the block size and the writes in flight (-i) so peak memory is about 8 x blockSize + the -i limit)" << std::endl; 
+        std::cout << "\t -a = adaptive coding (encode only.  higher compression at the cost of slower encoding and decoding)" << std::endl; 
+        std::cout << "\t -s = splitDepth (encode only.  sub blocks are split into 2^splitDepth independently decodable subtrees)" << std::endl; 
+        std::cout << "\t -c = subBlockSize (encode only.  default is chosen per block from the block size and alphabet)" << std::endl; 
+        std::cout << "\t -h = use transparent huge pages for block buffers" << std::endl; 
+        std::cout << "\t -k = checksums (encode only.  CRC32C of each sub block and block, verified when decoding.  on by default, -k0 = off)" << std::endl; 
+        std::cout << "\t -q = write queue depth (encode only.  the most block writes in flight)" << std::endl; 
+        std::cout << "\t -i = write bytes in flight (encode only.  the most encoded bytes waiting to be written)" << std::endl; 
+        std::cout << "\t -m = memory mapped input and output files (encode, decode and test.  not for stdin or stdout)" << std::endl; 
+        std::cout << "\t -o = offset (extract only.  first byte of the range)" << std::endl; 
+        std::cout << "\t -n = length (extract only.  number of bytes in the range.  default is to the end)" << std::endl; 
 
         std::cout << "example: m99 e inputFile outputFile -t8 -b100000" << std::endl;
+        std::cout << "example: m99 e inputFile outputFile -t8 -s3" << std::endl;
+        std::cout << "example: m99 e inputFile outputFile -t8 -a" << std::endl;
+        std::cout << "example: m99 e inputFile outputFile -t8 -c262144" << std::endl;
+        std::cout << "example: m99 e inputFile outputFile -t8 -q16 -i1073741824" << std::endl;
         std::cout << "example: m99 d inputFile outputFile -t8" << std::endl; 
+        std::cout << "example: m99 d inputFile outputFile -t8 -m" << std::endl; 
+        std::cout << "example: m99 x inputFile outputFile -t8 -o1048576 -n4096" << std::endl; 
+        std::cout << "example: m99 t inputFile -t8" << std::endl; 
+        std::cout << "example: pg_dump | m99 e - - -t8 | ... (\"-\" is stdin or stdout)" << std::endl; 
         return 0;
     }
 
 
+    //==========================================================================
+    template <typename consumer_type>
+    bool decode_blocks
+    (
+        // decodes each block of the frame which follows the frame header and passes it, in order, to 'consume'
+        // which returns false to stop early.  if 'outputFile' is given then each block is decoded directly into
+        // its place within it (it must be large enough for all of the blocks) rather than into a buffer.  returns
+        // false if the frame is corrupt or truncated.
+        decoder_input & input,
+        std::size_t numThreads,
+        maniscalco::m99_buffer_pool & bufferPool,
+        maniscalco::m99_mapped_file * outputFile,
+        consumer_type consume
+    )
+    {
+        std::uint64_t outputOffset = 0;
+        auto acquireOutput = [&](decoder_block & block)
+                {
+                    std::uint64_t blockSize = block.decoded_.header_.blockSize_;
+                    if (outputFile == nullptr)
+                    {
+                        block.output_ = bufferPool.acquire(blockSize);
+                        block.outputData_ = block.output_.data();
+                        return true;
+                    }
+                    if (blockSize > (outputFile->size() - outputOffset))
+                        return false;
+                    block.outputData_ = (outputFile->data() + outputOffset);
+                    outputOffset += blockSize;
+                    return true;
+                };
+
+        if (numThreads == 1)
+        {
+            while (true)
+            {
+                decoder_block block;
+                if (!read_block(input, block.encoded_, bufferPool))
+                    return false;
+                if (maniscalco::m99_is_end_of_frame(block.encoded_.header_))
+                    return true;
+                if (!maniscalco::m99_decode_sub_blocks(block.encoded_, block.decoded_, 1, bufferPool) || !acquireOutput(block) ||
+                        !maniscalco::m99_reverse_block(block.decoded_, block.outputData_, 1, bufferPool))
+                    return false;
+                if (!consume(block))
+                    return true;
+            }
+        }
+
+        // four stage pipeline.  block N + 1 is m99 decoded while block N is reversed (inverse BWT) and block N - 1 
+        // is consumed (written) and the next block is read ahead of them all.  the bounded queues between the stages 
+        // limit the number of blocks in flight.  a stage which stops closes the queues on either side of it which
+        // stops the earlier stages and lets the later stages finish the blocks already passed to them.
+        std::atomic<bool> corrupt{false};
+        maniscalco::m99_bounded_queue<decoder_block> readQueue(decoder_pipeline_depth);
+        maniscalco::m99_bounded_queue<decoder_block> decodedQueue(decoder_pipeline_depth);
+        maniscalco::m99_bounded_queue<decoder_block> reversedQueue(decoder_pipeline_depth);
+        std::thread readThread([&]()
+                {
+                    while (true)
+                    {
+                        decoder_block block;
+                        if (!read_block(input, block.encoded_, bufferPool))
+                        {
+                            corrupt = true;
+                            break;
+                        }
+                        if (maniscalco::m99_is_end_of_frame(block.encoded_.header_) || !readQueue.push(std::move(block)))
+                            break;
+                    }
+                    readQueue.close();
+                });
+        std::thread decodeThread([&]()
+                {
+                    while (auto block = readQueue.pop())
+                    {
+                        if (!maniscalco::m99_decode_sub_blocks(block->encoded_, block->decoded_, numThreads, bufferPool))
+                        {
+                            corrupt = true;
+                            break;
+                        }
+                        block->encoded_.data_.release();
+                        if (!decodedQueue.push(std::move(*block)))
+                            break;
+                    }
+                    decodedQueue.close();
+                    readQueue.close();
+                });
+        std::thread reverseThread([&]()
+                {
+                    while (auto block = decodedQueue.pop())
+                    {
+                        if (!acquireOutput(*block) || !maniscalco::m99_reverse_block(block->decoded_, block->outputData_, numThreads, bufferPool))
+                        {
+                            corrupt = true;
+                            break;
+                        }
+                        block->decoded_.bwt_.release();
+                        block->decoded_.symbolCounts_.release();
+                        if (!reversedQueue.push(std::move(*block)))
+                            break;
+                    }
+                    reversedQueue.close();
+                    decodedQueue.close();
+                });
+        while (auto block = reversedQueue.pop())
+            if (!consume(*block))
+                break;
+        reversedQueue.close();
+        decodedQueue.close();
+        readQueue.close();
+        reverseThread.join();
+        decodeThread.join();
+        readThread.join();
+        return !corrupt;
+    }
+
+
     //==========================================================================
     void decode
     (
         char const * inputPath,
         char const * outputPath,
-        int numThreads
+        int numThreads,
+        bool useMemoryMapping,
+        maniscalco::m99_buffer_pool::configuration_type const & bufferPoolConfiguration
     )
     {
-        // read data from file
-        std::ifstream inputStream(inputPath, std::ios_base::in | std::ios_base::binary);
-        if (!inputStream.is_open())
+        // open the input and output.  either may be a pipe so the input is read strictly in order and the end
+        // of the data is found from the frame's end marker.
+        auto startTime = std::chrono::system_clock::now();
+        decoder_input input;
+        if (!open_decoder_input(inputPath, useMemoryMapping, input))
+            return;
+
+        // a mapped input can be sized before decoding (from the block headers alone) so the output can be
+        // created at its final size and mapped.  each block is then decoded directly into its place in the
+        // output file rather than into a buffer which is then copied by a write.
+        maniscalco::m99_mapped_file outputFile;
+        std::unique_ptr<std::ostream> outStream;
+        bool mapOutput = false;
+        if ((!input.stream_) && (!is_standard_stream(outputPath)))
         {
-            std::cout << "failed to open file \"" << inputPath << "\"" << std::endl;
+            std::uint64_t decodedSize = 0;
+            auto current = input.current_;
+            maniscalco::m99_encoded_block encodedBlock;
+            while (maniscalco::m99_view_block(current, input.end_, input.limits_.maxBlockSize_, encodedBlock) && 
+                    (!maniscalco::m99_is_end_of_frame(encodedBlock.header_)))
+                decodedSize += encodedBlock.header_.blockSize_;
+            // a corrupt frame falls through to a streamed output so that the blocks before the fault are written
+            if (maniscalco::m99_is_end_of_frame(encodedBlock.header_))
+                mapOutput = outputFile.create(outputPath, decodedSize);
+        }
+        if (!mapOutput)
+        {
+            outStream = open_output_stream(outputPath);
+            if (!outStream)
+                return;
+        }
+
+        // block buffers are pooled so that each block after the first reuses the memory of the previous blocks.
+        // a fixed number of blocks are in flight so memory is bounded by the block size rather than by the input size.
+        maniscalco::m99_buffer_pool bufferPool(bufferPoolConfiguration);
+
+        std::size_t outputSize = 0;
+        auto valid = decode_blocks(input, numThreads, bufferPool, mapOutput ? &outputFile : nullptr, [&](decoder_block const & block)
+                {
+                    std::size_t blockSize = block.decoded_.header_.blockSize_;
+                    outputSize += blockSize;
+                    if (mapOutput)
+                        return true;
+                    outStream->write((char const *)block.outputData_, blockSize);
+                    return (bool)*outStream;
+                });
+        if (!valid)
+        {
+            std::cout << "\"" << inputPath << "\" is corrupt or truncated" << std::endl;
+            return;
+        }
+        if ((!mapOutput) && (!outStream->flush()))
+        {
+            std::cout << "failed to write to \"" << outputPath << "\"" << std::endl;
+            return;
+        }
+
+        auto finishTime = std::chrono::system_clock::now();
+        auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(finishTime - startTime).count();
+        std::cout << "Elapsed time: " << ((long double)elapsedTime / 1000) << " seconds : " <<  (((long double)outputSize / (1 << 20)) / ((double)elapsedTime / 1000)) << " MB/sec" << std::endl;
+    }
+
+
+    //==========================================================================
+    void test
+    (
+        // decodes every block and verifies its checksums (if present) without writing any output
+        char const * inputPath,
+        int numThreads,
+        bool useMemoryMapping,
+        maniscalco::m99_buffer_pool::configuration_type const & bufferPoolConfiguration
+    )
+    {
+        maniscalco::m99_buffer_pool bufferPool(bufferPoolConfiguration);
+        auto startTime = std::chrono::system_clock::now();
+        decoder_input input;
+        if (!open_decoder_input(inputPath, useMemoryMapping, input))
+            return;
+
+        std::size_t numBlocks = 0;
+        std::size_t numVerifiedBlocks = 0;
+        std::size_t bytesDecoded = 0;
+        auto valid = decode_blocks(input, numThreads, bufferPool, nullptr, [&](decoder_block const & block)
+                {
+                    ++numBlocks;
+                    numVerifiedBlocks += block.decoded_.hasChecksum_;
+                    bytesDecoded += block.decoded_.header_.blockSize_;
+                    return true;
+                });
+        if (!valid)
+        {
+            std::cout << "\"" << inputPath << "\" is corrupt or truncated at block " << numBlocks << 
+                    " (original offset " << bytesDecoded << ")" << std::endl;
             return;
         }
 
-        // create the output stream
-        std::ofstream outStream(outputPath, std::ios_base::out | std::ios_base::binary);
-        if (!outStream.is_open())
+        auto finishTime = std::chrono::system_clock::now();
+        auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(finishTime - startTime).count();
+        std::cout << "ok: " << numBlocks << " blocks, " << bytesDecoded << " bytes.  " << numVerifiedBlocks << " blocks have checksums" << std::endl;
+        std::cout << "Elapsed time: " << ((long double)elapsedTime / 1000) << " seconds : " <<  (((long double)bytesDecoded / (1 << 20)) / ((double)elapsedTime / 1000)) << " MB/sec" << std::endl;
+    }
+
+
+    //==========================================================================
+    void extract
+    (
+        // decodes only the bytes [offset, offset + length) of the original data
+        char const * inputPath,
+        char const * outputPath,
+        int numThreads,
+        std::uint64_t offset,
+        std::uint64_t length,
+        maniscalco::m99_buffer_pool::configuration_type const & bufferPoolConfiguration
+    )
+    {
+        // the input must be seekable so that the blocks outside of the range can be skipped
+        if (is_standard_stream(inputPath))
         {
-            std::cout << "failed to create output file \"" << outputPath << "\"" << std::endl;
+            std::cout << "extract requires an input file rather than stdin" << std::endl;
             return;
         }
+        auto inputStream = open_input_stream(inputPath);
+        if (!inputStream)
+            return;
+        auto outStream = open_output_stream(outputPath);
+        if (!outStream)
+            return;
 
         auto startTime = std::chrono::system_clock::now();
-        inputStream.seekg(0, std::ios_base::end);
-        auto end = inputStream.tellg();
-        inputStream.seekg(0, std::ios_base::beg);
 
-        if (numThreads == 1)
+        // locate the blocks from their headers alone
+        std::vector<maniscalco::m99_block_location> blockLocations;
+        if (!maniscalco::m99_read_block_index(*inputStream, blockLocations))
         {
-            while (inputStream.tellg() != end)
-                decode_block(inputStream, outStream);
+            std::cout << "\"" << inputPath << "\" is not an m99 file or is corrupt" << std::endl;
+            return;
         }
-        else
+        std::uint64_t decodedSize = blockLocations.empty() ? 0 : (blockLocations.back().decodedOffset_ + blockLocations.back().decodedSize_);
+        if (offset > decodedSize)
         {
-            while (inputStream.tellg() != end)
-                decode_block(inputStream, outStream, numThreads);
+            std::cout << "offset " << offset << " is beyond the end of the data (" << decodedSize << " bytes)" << std::endl;
+            return;
+        }
+        length = std::min(length, decodedSize - offset);
+
+        // each block is written as soon as it is decoded so memory is bounded by the block size rather than by
+        // the length of the range
+        maniscalco::m99_buffer_pool bufferPool(bufferPoolConfiguration);
+        bool written = true;
+        auto valid = maniscalco::m99_decode_range(*inputStream, blockLocations, offset, length, [&](std::uint8_t const * data, std::size_t size)
+                {
+                    written = (bool)outStream->write((char const *)data, size);
+                    return written;
+                }, numThreads, bufferPool);
+        if ((!written) || (!outStream->flush()))
+        {
+            std::cout << "failed to write to \"" << outputPath << "\"" << std::endl;
+            return;
+        }
+        if (!valid)
+        {
+            std::cout << "\"" << inputPath << "\" is corrupt or truncated" << std::endl;
+            return;
         }
 
         auto finishTime = std::chrono::system_clock::now();
         auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(finishTime - startTime).count();
-        std::cout << "Elapsed time: " << ((long double)elapsedTime / 1000) << " seconds" << std::endl;
-
-        inputStream.close();
-        outStream.close();
+        std::cout << "extracted " << length << " bytes at offset " << offset << ".  Elapsed time: " << ((long double)elapsedTime / 1000) << " seconds" << std::endl;
     }
 
 
@@ -360,54 +772,183 @@ namespace
         char const * inputPath,
         char const * outputPath,
         int numThreads,
-        int blockSize
+        int blockSize,
+        std::uint32_t subBlockSize,
+        maniscalco::m99_encode_options const & encodeOptions,
+        bool useChecksums,
+        bool useMemoryMapping,
+        maniscalco::m99_async_writer::configuration_type const & writerConfiguration,
+        maniscalco::m99_buffer_pool::configuration_type const & bufferPoolConfiguration
     )
     {
-        // create the output stream
-        std::ofstream outStream(outputPath, std::ios_base::out | std::ios_base::binary);
-        if (!outStream.is_open())
+        auto startTime = std::chrono::system_clock::now();
+
+        // read data from the input (which may be a pipe) one block at a time.  block buffers are pooled so that
+        // each block after the first reuses the memory of the previous blocks and memory is bounded by the block
+        // size rather than by the input size.
+        maniscalco::m99_buffer_pool bufferPool(bufferPoolConfiguration);
+        // the working state of the m99 coder is likewise kept from block to block
+        maniscalco::m99_encode_context encodeContext;
+        auto blockEncodeOptions = encodeOptions;
+        blockEncodeOptions.context_ = &encodeContext;
+        // alternatively a file is mapped privately (copy on write) and each block is transformed in place within
+        // the mapping.  this saves reading the block into a buffer.  once a block has been written its pages are
+        // discarded which frees the copies made by the transform so memory remains bounded by the block size.
+        maniscalco::m99_mapped_file inputFile;
+        std::unique_ptr<std::istream> inputStream;
+        auto mapInput = (useMemoryMapping && (!is_standard_stream(inputPath)) && 
+                inputFile.open(inputPath, maniscalco::m99_mapped_file::access_type::copy_on_write));
+        if (mapInput)
         {
-            std::cout << "failed to create output file \"" << outputPath << "\"" << std::endl;
-            return;
+            inputFile.advise_sequential();
+        }
+        else
+        {
+            inputStream = open_input_stream(inputPath);
+            if (!inputStream)
+                return;
         }
 
-        auto startTime = std::chrono::system_clock::now();
+        // the output is written by a writer of its own so that neither the coding of the next block nor the
+        // transform of the block after it waits for storage.  the writer holds the encoded sub blocks until they
+        // are written which the queue depth and bytes in flight bound.
+        auto outputFileDescriptor = open_output_file(outputPath);
+        if (outputFileDescriptor < 0)
+            return;
+        maniscalco::m99_async_writer writer(outputFileDescriptor, writerConfiguration);
+        std::size_t outputSize = 0;
+        auto writeHead = [&](void const * data, std::size_t size)
+                {
+                    maniscalco::m99_async_writer::request_type request;
+                    request.head_.assign((std::uint8_t const *)data, (std::uint8_t const *)data + size);
+                    outputSize += size;
+                    return writer.write(std::move(request));
+                };
 
-        // read data from file
-        std::vector<std::uint8_t> input;
-        input.reserve(blockSize);
-        std::ifstream inputStream(inputPath, std::ios_base::in | std::ios_base::binary);
-        if (!inputStream.is_open())
+        maniscalco::m99_frame_header frameHeader
         {
-            std::cout << "failed to open file \"" << inputPath << "\"" << std::endl;
-            return;
-        }
+            .magic_ = maniscalco::m99_frame_magic,
+            .version_ = maniscalco::m99_frame_version,
+            .flags_ = 0,
+            .maxBlockSize_ = (std::uint32_t)blockSize
+        };
+        writeHead(&frameHeader, sizeof(frameHeader));
 
         std::size_t bytesEncoded = 0;
-        inputStream.seekg(0, std::ios_base::beg);
-        while (true)
+        std::vector<maniscalco::m99_block_index_entry> blockIndex;
+        std::size_t numSubBlocks = 0;
+        std::uint32_t minSubBlockSize = ~0;
+        std::uint32_t maxSubBlockSize = 0;
+        std::size_t inputOffset = 0;
+        auto readBlock = [&]()
+                {
+                    encoder_block block;
+                    if (mapInput)
+                    {
+                        block.begin_ = (inputFile.data() + inputOffset);
+                        block.size_ = std::min<std::size_t>(blockSize, inputFile.size() - inputOffset);
+                        inputOffset += block.size_;
+                        return block;
+                    }
+                    block.data_ = bufferPool.acquire(blockSize);
+                    block.begin_ = block.data_.data();
+                    inputStream->read((char *)block.data_.data(), block.data_.size());
+                    block.size_ = inputStream->gcount();
+                    return block;
+                };
+        auto codeBlock = [&](encoder_block const & block)
+                {
+                    blockIndex.push_back({.position_ = outputSize, .decodedOffset_ = bytesEncoded});
+                    auto bytesWritten = encode_transformed_block(block, writer, numThreads, blockEncodeOptions, useChecksums, bufferPool);
+                    if (mapInput)
+                        inputFile.discard(block.begin_ - inputFile.data(), block.size_);
+                    outputSize += bytesWritten;
+                    bytesEncoded += block.size_;
+                    numSubBlocks += ((block.size_ + block.subBlockSize_ - 1) / block.subBlockSize_);
+                    minSubBlockSize = std::min(minSubBlockSize, block.subBlockSize_);
+                    maxSubBlockSize = std::max(maxSubBlockSize, block.subBlockSize_);
+                    return (bytesWritten > 0);
+                };
+
+        if (numThreads == 1)
         {
-            inputStream.read((char *)input.data(), input.capacity());
-            auto size = inputStream.gcount();
-            if (size == 0)
-                break;
-            bytesEncoded += size;
-            if (numThreads == 1)
-                encode_block(input.data(), input.data() + size, outStream);
-            else
-                encode_block(input.data(), input.data() + size, outStream, numThreads);
+            for (auto block = readBlock(); block.size_ > 0; block = readBlock())
+            {
+                transform_block(block, 1, subBlockSize, useChecksums);
+                if (!codeBlock(block))
+                    break;
+            }
+        }
+        else
+        {
+            // three stage pipeline.  block N + 1 is read while block N is transformed (BWT) and block N - 1
+            // is m99 coded and written.  the bounded queues between the stages limit the number of blocks
+            // in flight.  closing the queues downstream of a failure stops the earlier stages.
+            maniscalco::m99_bounded_queue<encoder_block> readQueue(encoder_pipeline_depth);
+            maniscalco::m99_bounded_queue<encoder_block> transformedQueue(encoder_pipeline_depth);
+            std::thread readThread([&]()
+                    {
+                        for (auto block = readBlock(); block.size_ > 0; block = readBlock())
+                            if (!readQueue.push(std::move(block)))
+                                break;
+                        readQueue.close();
+                    });
+            std::thread transformThread([&]()
+                    {
+                        while (auto block = readQueue.pop())
+                        {
+                            transform_block(*block, numThreads, subBlockSize, useChecksums);
+                            if (!transformedQueue.push(std::move(*block)))
+                                break;
+                        }
+                        transformedQueue.close();
+                        readQueue.close();
+                    });
+            while (auto block = transformedQueue.pop())
+                if (!codeBlock(*block))
+                    break;
+            transformedQueue.close();
+            readQueue.close();
+            transformThread.join();
+            readThread.join();
+        }
+
+        // mark the end of the frame so that readers need not know the size of the input.  the block index and the
+        // trailer which locates it follow so that a reader which can seek need not walk the blocks.
+        maniscalco::m99_block_header endOfFrame;
+        writeHead(&endOfFrame, sizeof(endOfFrame));
+        maniscalco::m99_frame_trailer frameTrailer
+        {
+            .indexPosition_ = outputSize,
+            .decodedSize_ = bytesEncoded,
+            .blockCount_ = (std::uint32_t)blockIndex.size(),
+            .magic_ = maniscalco::m99_frame_trailer_magic
+        };
+        writeHead(blockIndex.data(), blockIndex.size() * sizeof(maniscalco::m99_block_index_entry));
+        writeHead(&frameTrailer, sizeof(frameTrailer));
+        auto written = writer.close();
+        if ((!is_standard_stream(outputPath)) && (::close(outputFileDescriptor) != 0))
+            written = false;
+        if (!written)
+        {
+            std::cout << "failed to write to \"" << outputPath << "\"" << std::endl;
+            return;
         }
         auto finishTime = std::chrono::system_clock::now();
         auto elapsedOverallEncode = std::chrono::duration_cast<std::chrono::milliseconds>(finishTime - startTime).count();
 
         std::size_t inputSize = bytesEncoded;
-        std::size_t outputSize = outStream.tellp();
 
         std::cout << "compressed: " << inputSize << " -> " << outputSize << " bytes.  ratio = " << (((long double)outputSize / inputSize) * 100) << "%" << std::endl;
         std::cout << "Elapsed time: " << ((long double)elapsedOverallEncode / 1000) << " seconds : " <<  (((long double)inputSize / (1 << 20)) / ((double)elapsedOverallEncode / 1000)) << " MB/sec" << std::endl;
-
-        outStream.close();
-        inputStream.close();
+        if (numSubBlocks > 0)
+        {
+            // smaller sub blocks balance the load across more threads, larger sub blocks spend less on headers
+            std::cout << "sub blocks: " << numSubBlocks << " of " << minSubBlockSize;
+            if (maxSubBlockSize != minSubBlockSize)
+                std::cout << " - " << maxSubBlockSize;
+            std::cout << " bytes" << ((subBlockSize == 0) ? " (adaptive)" : "") << std::endl;
+        }
     }
 
 }
@@ -420,14 +961,31 @@ std::int32_t main
     char const * argValue[]
 )
 {
+    std::ios_base::sync_with_stdio(false);
+    standard_output = std::cout.rdbuf();
+
+    // test mode has no output file
+    auto firstSwitch = ((argCount > 1) && (argValue[1][0] == 't')) ? 3 : 4;
+    // when writing to stdout all messages go to stderr instead
+    if ((firstSwitch == 4) && (argCount > 3) && (is_standard_stream(argValue[3])))
+        std::cout.rdbuf(std::cerr.rdbuf());
+
     print_about();
 
-    if ((argCount < 4) || (strlen(argValue[1]) != 1))
+    if ((argCount < firstSwitch) || (strlen(argValue[1]) != 1))
         return print_usage();
 
     std::size_t numThreads = 0;
-    std::size_t maxBlockSize = (1 << 30);
-    for (auto argIndex = 4; argIndex < argCount; ++argIndex)
+    std::size_t maxBlockSize = maniscalco::m99_max_block_size;
+    maniscalco::m99_encode_options encodeOptions;
+    maniscalco::m99_buffer_pool::configuration_type bufferPoolConfiguration;
+    maniscalco::m99_async_writer::configuration_type writerConfiguration;
+    std::uint32_t subBlockSize = 0;
+    bool useChecksums = true;
+    bool useMemoryMapping = false;
+    std::uint64_t offset = 0;
+    std::uint64_t length = ~0ull;
+    for (auto argIndex = firstSwitch; argIndex < argCount; ++argIndex)
     {
         if (argValue[argIndex][0] != '-')
             return print_usage();
@@ -451,8 +1009,7 @@ std::int32_t main
                     maxBlockSize += (*cur - '0');
                     ++cur;
                 }
-                if (maxBlockSize > (1 << 30))
-                    maxBlockSize = (1 << 30);
+                maxBlockSize = std::clamp<std::size_t>(maxBlockSize, 1, maniscalco::m99_max_block_size);
                 break;
             }
             case 't':
@@ -474,6 +1031,115 @@ std::int32_t main
                 }
                 break;
             }
+            case 's':
+            {
+                // split depth
+                std::uint32_t splitDepth = 0;
+                auto cur = argValue[argIndex] + 2;
+                while (*cur != 0)
+                {
+                    if ((*cur < '0') || (*cur > '9'))
+                    {
+                        std::cout << "invalid split depth" << std::endl;
+                        print_usage();
+                        return -1;
+                    }
+                    splitDepth *= 10;
+                    splitDepth += (*cur - '0');
+                    ++cur;
+                }
+                encodeOptions.splitDepth_ = std::min<std::uint32_t>(splitDepth, maniscalco::m99_max_split_depth);
+                break;
+            }
+            case 'a':
+            {
+                // adaptive coding
+                encodeOptions.adaptiveCoding_ = true;
+                break;
+            }
+            case 'c':
+            {
+                // sub block size
+                std::uint64_t size = 0;
+                auto cur = argValue[argIndex] + 2;
+                while (*cur != 0)
+                {
+                    if ((*cur < '0') || (*cur > '9'))
+                    {
+                        std::cout << "invalid sub block size" << std::endl;
+                        print_usage();
+                        return -1;
+                    }
+                    size *= 10;
+                    size += (*cur - '0');
+                    ++cur;
+                }
+                subBlockSize = std::clamp<std::uint64_t>(size, min_sub_block_size, max_sub_block_size);
+                break;
+            }
+            case 'h':
+            {
+                // transparent huge pages
+                bufferPoolConfiguration.useHugePages_ = true;
+                break;
+            }
+            case 'k':
+            {
+                // checksums (-k0 turns them off)
+                useChecksums = (argValue[argIndex][2] != '0');
+                break;
+            }
+            case 'q':
+            case 'i':
+            {
+                // queue depth or bytes in flight of the writer
+                std::uint64_t value = 0;
+                auto cur = argValue[argIndex] + 2;
+                while (*cur != 0)
+                {
+                    if ((*cur < '0') || (*cur > '9'))
+                    {
+                        std::cout << "invalid " << ((argValue[argIndex][1] == 'q') ? "queue depth" : "bytes in flight") << std::endl;
+                        print_usage();
+                        return -1;
+                    }
+                    value *= 10;
+                    value += (*cur - '0');
+                    ++cur;
+                }
+                if (argValue[argIndex][1] == 'q')
+                    writerConfiguration.queueDepth_ = std::max<std::uint64_t>(value, 1);
+                else
+                    writerConfiguration.maxBytesInFlight_ = value;
+                break;
+            }
+            case 'm':
+            {
+                // memory mapped files
+                useMemoryMapping = true;
+                break;
+            }
+            case 'o':
+            case 'n':
+            {
+                // offset or length of the range to extract
+                std::uint64_t value = 0;
+                auto cur = argValue[argIndex] + 2;
+                while (*cur != 0)
+                {
+                    if ((*cur < '0') || (*cur > '9'))
+                    {
+                        std::cout << "invalid " << ((argValue[argIndex][1] == 'o') ? "offset" : "length") << std::endl;
+                        print_usage();
+                        return -1;
+                    }
+                    value *= 10;
+                    value += (*cur - '0');
+                    ++cur;
+                }
+                ((argValue[argIndex][1] == 'o') ? offset : length) = value;
+                break;
+            }
             default:
             {
                 std::cout << "unknown switch: " << argValue[argIndex] << std::endl;
@@ -488,13 +1154,25 @@ std::int32_t main
     {
         case 'e':
         {
-            encode(argValue[2], argValue[3], numThreads, maxBlockSize);
+            encode(argValue[2], argValue[3], numThreads, maxBlockSize, subBlockSize, encodeOptions, useChecksums, useMemoryMapping, writerConfiguration, bufferPoolConfiguration);
             break;
         }
 
         case 'd':
         {
-            decode(argValue[2], argValue[3], numThreads);
+            decode(argValue[2], argValue[3], numThreads, useMemoryMapping, bufferPoolConfiguration);
+            break;
+        }
+
+        case 't':
+        {
+            test(argValue[2], numThreads, useMemoryMapping, bufferPoolConfiguration);
+            break;
+        }
+
+        case 'x':
+        {
+            extract(argValue[2], argValue[3], numThreads, offset, length, bufferPoolConfiguration);
             break;
         }
 
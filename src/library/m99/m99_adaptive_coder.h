@@ -0,0 +1,465 @@
+#pragma once
+
+#include "./m99_decode_stream.h"
+
+#include <cstdint>
+#include <vector>
+
+
+namespace maniscalco
+{
+
+    //=========================================================================
+    // adaptive binary models for the high ratio mode.  a value 'v' in [0, total] is coded relative to its
+    // expected value 'e' as the bit length of |v - e| (unary), the sign and then the remaining bits of |v - e|.
+    // the unary and leading bits are modelled in a context selected by the depth of the node in the tree
+    // and by the bit length of the total.
+    class m99_adaptive_model
+    {
+    public:
+
+        using probability_type = std::uint16_t;
+
+        static auto constexpr probability_bits = 11;
+        static auto constexpr adaptation_shift = 5;
+        static auto constexpr max_depth_context = 32;
+        static auto constexpr max_total_context = 32;
+        static auto constexpr max_magnitude_length = 33;
+
+        m99_adaptive_model();
+
+        probability_type * magnitude_length
+        (
+            std::uint32_t
+        );
+
+        probability_type & sign
+        (
+            std::uint32_t
+        );
+
+        probability_type & extreme
+        (
+            std::uint32_t
+        );
+
+        probability_type & extreme_side
+        (
+            std::uint32_t
+        );
+
+        probability_type * leading_bit
+        (
+            std::uint32_t
+        );
+
+        probability_type * trailing_bits
+        (
+            std::uint32_t
+        );
+
+        probability_type & leaf_bit
+        (
+            std::uint32_t
+        );
+
+        static std::uint32_t context
+        (
+            std::uint32_t,
+            std::uint32_t
+        );
+
+        static std::uint32_t expected_value
+        (
+            std::uint32_t,
+            std::uint32_t,
+            std::uint32_t
+        );
+
+    private:
+
+        static auto constexpr context_count = (max_depth_context * max_total_context);
+
+        std::vector<probability_type> probabilities_;
+
+    }; // class m99_adaptive_model
+
+
+    //=========================================================================
+    // binary range coder (carry propagating, 32 bit range).  bytes are produced in decode order.
+    class m99_range_encoder
+    {
+    public:
+
+        void encode_bit
+        (
+            m99_adaptive_model::probability_type &,
+            std::uint32_t
+        );
+
+        void encode_value
+        (
+            m99_adaptive_model &,
+            std::uint32_t,
+            std::uint32_t,
+            std::uint32_t,
+            std::uint32_t
+        );
+
+        void flush();
+
+        std::vector<std::uint8_t> const & data() const;
+
+    private:
+
+        void shift_low();
+
+        std::vector<std::uint8_t> data_;
+
+        std::uint64_t low_{0};
+
+        std::uint32_t range_{0xffffffff};
+
+        std::uint8_t cache_{0};
+
+        std::uint64_t cacheSize_{1};
+
+    }; // class m99_range_encoder
+
+
+    //=========================================================================
+    class m99_range_decoder
+    {
+    public:
+
+        m99_range_decoder
+        (
+            m99_decode_stream &
+        );
+
+        std::uint32_t decode_bit
+        (
+            m99_adaptive_model::probability_type &
+        );
+
+        std::uint32_t decode_value
+        (
+            m99_adaptive_model &,
+            std::uint32_t,
+            std::uint32_t,
+            std::uint32_t
+        );
+
+    private:
+
+        m99_decode_stream & decodeStream_;
+
+        std::uint32_t code_{0};
+
+        std::uint32_t range_{0xffffffff};
+
+    }; // class m99_range_decoder
+
+} // namespace maniscalco
+
+
+//=============================================================================
+inline maniscalco::m99_adaptive_model::m99_adaptive_model
+(
+):
+    // per context: magnitude lengths, sign and leading bits.  then trailing bits by magnitude length and leaf bits by depth.
+    probabilities_((context_count * (max_magnitude_length + 1 + max_magnitude_length)) +
+            (max_magnitude_length * max_magnitude_length) + max_depth_context + (context_count * 3), (1 << (probability_bits - 1)))
+{
+}
+
+
+//=============================================================================
+inline std::uint32_t maniscalco::m99_adaptive_model::context
+(
+    std::uint32_t depth,
+    std::uint32_t total
+)
+{
+    // total is non zero
+    auto totalLength = (31 - __builtin_clz(total));
+    return (((depth < max_depth_context) ? depth : (max_depth_context - 1)) * max_total_context) + totalLength;
+}
+
+
+//=============================================================================
+inline std::uint32_t maniscalco::m99_adaptive_model::expected_value
+(
+    // expected value of the left count given 'total' and the (inferred) space remaining on either side
+    std::uint32_t total,
+    std::uint32_t maxLeft,
+    std::uint32_t maxRight
+)
+{
+    return (((std::uint64_t)total * maxLeft) / ((std::uint64_t)maxLeft + maxRight));
+}
+
+
+//=============================================================================
+inline auto maniscalco::m99_adaptive_model::magnitude_length
+(
+    std::uint32_t context
+) -> probability_type *
+{
+    return (probabilities_.data() + (context * max_magnitude_length));
+}
+
+
+//=============================================================================
+inline auto maniscalco::m99_adaptive_model::sign
+(
+    std::uint32_t context
+) -> probability_type &
+{
+    return probabilities_[(context_count * max_magnitude_length) + context];
+}
+
+
+//=============================================================================
+inline auto maniscalco::m99_adaptive_model::extreme
+(
+    // is the value either zero or the total?
+    std::uint32_t context
+) -> probability_type &
+{
+    return probabilities_[probabilities_.size() - (context_count * 3) + context];
+}
+
+
+//=============================================================================
+inline auto maniscalco::m99_adaptive_model::extreme_side
+(
+    std::uint32_t context
+) -> probability_type &
+{
+    return probabilities_[probabilities_.size() - (context_count * 2) + context];
+}
+
+
+//=============================================================================
+inline auto maniscalco::m99_adaptive_model::leading_bit
+(
+    std::uint32_t context
+) -> probability_type *
+{
+    return (probabilities_.data() + (context_count * (max_magnitude_length + 1)) + (context * max_magnitude_length));
+}
+
+
+//=============================================================================
+inline auto maniscalco::m99_adaptive_model::trailing_bits
+(
+    std::uint32_t magnitudeLength
+) -> probability_type *
+{
+    return (probabilities_.data() + (context_count * (max_magnitude_length + 1 + max_magnitude_length)) +
+            (magnitudeLength * max_magnitude_length));
+}
+
+
+//=============================================================================
+inline auto maniscalco::m99_adaptive_model::leaf_bit
+(
+    std::uint32_t depth
+) -> probability_type &
+{
+    return probabilities_[(context_count * (max_magnitude_length + 1 + max_magnitude_length)) +
+            (max_magnitude_length * max_magnitude_length) + ((depth < max_depth_context) ? depth : (max_depth_context - 1))];
+}
+
+
+//=============================================================================
+inline void maniscalco::m99_range_encoder::encode_bit
+(
+    m99_adaptive_model::probability_type & probability,
+    std::uint32_t bit
+)
+{
+    auto bound = ((range_ >> m99_adaptive_model::probability_bits) * probability);
+    if (bit == 0)
+    {
+        range_ = bound;
+        probability += (((1 << m99_adaptive_model::probability_bits) - probability) >> m99_adaptive_model::adaptation_shift);
+    }
+    else
+    {
+        low_ += bound;
+        range_ -= bound;
+        probability -= (probability >> m99_adaptive_model::adaptation_shift);
+    }
+    while (range_ < (1 << 24))
+    {
+        range_ <<= 8;
+        shift_low();
+    }
+}
+
+
+//=============================================================================
+inline void maniscalco::m99_range_encoder::shift_low
+(
+)
+{
+    if (((std::uint32_t)low_ < 0xff000000) || ((low_ >> 32) != 0))
+    {
+        std::uint8_t carry = (low_ >> 32);
+        auto temp = cache_;
+        do
+        {
+            data_.push_back((std::uint8_t)(temp + carry));
+            temp = 0xff;
+        } while (--cacheSize_ != 0);
+        cache_ = (std::uint8_t)(low_ >> 24);
+    }
+    ++cacheSize_;
+    low_ = ((low_ & 0x00ffffff) << 8);
+}
+
+
+//=============================================================================
+inline void maniscalco::m99_range_encoder::encode_value
+(
+    // encode 'value' in [0, total] where total is non zero
+    m99_adaptive_model & model,
+    std::uint32_t value,
+    std::uint32_t total,
+    std::uint32_t expected,
+    std::uint32_t depth
+)
+{
+    auto context = m99_adaptive_model::context(depth, total);
+    auto isExtreme = ((value == 0) || (value == total));
+    if (total > 1)
+        encode_bit(model.extreme(context), isExtreme);
+    if (isExtreme)
+    {
+        encode_bit(model.extreme_side((context << 1) | ((expected << 1) >= total)), value == total);
+        return;
+    }
+
+    // value is in [1, total - 1]
+    expected = (expected < 1) ? 1 : (expected > (total - 1)) ? (total - 1) : expected;
+    auto magnitude = (value >= expected) ? (value - expected) : (expected - value);
+    std::uint32_t magnitudeLength = (magnitude == 0) ? 0 : (32 - __builtin_clz(magnitude));
+    auto maxMagnitude = (((total - 1) - expected) > (expected - 1)) ? ((total - 1) - expected) : (expected - 1);
+    std::uint32_t maxMagnitudeLength = (maxMagnitude == 0) ? 0 : (32 - __builtin_clz(maxMagnitude));
+
+    auto probability = model.magnitude_length(context);
+    for (std::uint32_t i = 0; i < magnitudeLength; ++i)
+        encode_bit(probability[i], 1);
+    if (magnitudeLength < maxMagnitudeLength)
+        encode_bit(probability[magnitudeLength], 0);
+    if (magnitudeLength == 0)
+        return;
+    encode_bit(model.sign(context), value < expected);
+    if (magnitudeLength == 1)
+        return;
+    encode_bit(model.leading_bit(context)[magnitudeLength], (magnitude >> (magnitudeLength - 2)) & 1);
+    probability = model.trailing_bits(magnitudeLength);
+    for (auto i = (std::int32_t)magnitudeLength - 3; i >= 0; --i)
+        encode_bit(probability[i], (magnitude >> i) & 1);
+}
+
+
+//=============================================================================
+inline void maniscalco::m99_range_encoder::flush
+(
+)
+{
+    for (auto i = 0; i < 5; ++i)
+        shift_low();
+}
+
+
+//=============================================================================
+inline std::vector<std::uint8_t> const & maniscalco::m99_range_encoder::data
+(
+) const
+{
+    return data_;
+}
+
+
+//=============================================================================
+inline maniscalco::m99_range_decoder::m99_range_decoder
+(
+    m99_decode_stream & decodeStream
+):
+    decodeStream_(decodeStream)
+{
+    for (auto i = 0; i < 5; ++i)
+        code_ = ((code_ << 8) | decodeStream_.pop(8));
+}
+
+
+//=============================================================================
+inline std::uint32_t maniscalco::m99_range_decoder::decode_bit
+(
+    m99_adaptive_model::probability_type & probability
+)
+{
+    std::uint32_t bit;
+    auto bound = ((range_ >> m99_adaptive_model::probability_bits) * probability);
+    if (code_ < bound)
+    {
+        range_ = bound;
+        probability += (((1 << m99_adaptive_model::probability_bits) - probability) >> m99_adaptive_model::adaptation_shift);
+        bit = 0;
+    }
+    else
+    {
+        code_ -= bound;
+        range_ -= bound;
+        probability -= (probability >> m99_adaptive_model::adaptation_shift);
+        bit = 1;
+    }
+    while (range_ < (1 << 24))
+    {
+        range_ <<= 8;
+        code_ = ((code_ << 8) | decodeStream_.pop(8));
+    }
+    return bit;
+}
+
+
+//=============================================================================
+inline std::uint32_t maniscalco::m99_range_decoder::decode_value
+(
+    // decode a value in [0, total] where total is non zero
+    m99_adaptive_model & model,
+    std::uint32_t total,
+    std::uint32_t expected,
+    std::uint32_t depth
+)
+{
+    auto context = m99_adaptive_model::context(depth, total);
+    if ((total == 1) || decode_bit(model.extreme(context)))
+        return (decode_bit(model.extreme_side((context << 1) | ((expected << 1) >= total))) ? total : 0);
+
+    // value is in [1, total - 1]
+    expected = (expected < 1) ? 1 : (expected > (total - 1)) ? (total - 1) : expected;
+    auto maxMagnitude = (((total - 1) - expected) > (expected - 1)) ? ((total - 1) - expected) : (expected - 1);
+    std::uint32_t maxMagnitudeLength = (maxMagnitude == 0) ? 0 : (32 - __builtin_clz(maxMagnitude));
+
+    auto probability = model.magnitude_length(context);
+    std::uint32_t magnitudeLength = 0;
+    while ((magnitudeLength < maxMagnitudeLength) && decode_bit(probability[magnitudeLength]))
+        ++magnitudeLength;
+    if (magnitudeLength == 0)
+        return expected;
+    auto negative = decode_bit(model.sign(context));
+    std::uint32_t magnitude = 1;
+    if (magnitudeLength > 1)
+    {
+        magnitude = ((magnitude << 1) | decode_bit(model.leading_bit(context)[magnitudeLength]));
+        probability = model.trailing_bits(magnitudeLength);
+        for (auto i = (std::int32_t)magnitudeLength - 3; i >= 0; --i)
+            magnitude = ((magnitude << 1) | decode_bit(probability[i]));
+    }
+    return negative ? (expected - magnitude) : (expected + magnitude);
+}
@@ -0,0 +1,585 @@
+#include "./m99_async_writer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+    #define M99_IO_URING
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+#endif
+
+
+namespace
+{
+
+    // the most iovecs which a single writev (or io_uring writev) accepts
+    static auto constexpr max_iovecs = 1024;
+
+
+    //==================================================================================================================
+    void consume
+    (
+        // advances past the first 'size' bytes of the iovecs
+        iovec * & iovecs,
+        std::size_t & numIovecs,
+        std::size_t size
+    )
+    {
+        while ((numIovecs > 0) && (size >= iovecs->iov_len))
+        {
+            size -= iovecs->iov_len;
+            ++iovecs;
+            --numIovecs;
+        }
+        if (numIovecs > 0)
+        {
+            iovecs->iov_base = ((std::uint8_t *)iovecs->iov_base + size);
+            iovecs->iov_len -= size;
+        }
+    }
+
+
+    //==================================================================================================================
+    bool write_fully
+    (
+        // writes all of 'iovecs' starting at 'offset' (or at the current position if the output is not seekable)
+        // resuming after partial writes.  the iovecs are consumed.  a write which makes no progress is a failure
+        // rather than something to retry forever.
+        int fileDescriptor,
+        bool seekable,
+        std::uint64_t offset,
+        iovec * iovecs,
+        std::size_t numIovecs
+    )
+    {
+        while (numIovecs > 0)
+        {
+            auto count = std::min<std::size_t>(numIovecs, max_iovecs);
+            auto written = seekable ? ::pwritev(fileDescriptor, iovecs, count, offset) : ::writev(fileDescriptor, iovecs, count);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            if (written == 0)
+                return false;
+            offset += written;
+            consume(iovecs, numIovecs, written);
+        }
+        return true;
+    }
+
+
+    // a request which has been submitted.  the iovecs must outlive the writes since io_uring may read them after
+    // submission.  a request with more than max_iovecs segments is written as several chunks.
+    struct in_flight_type
+    {
+        struct chunk_type
+        {
+            in_flight_type * owner_;
+            std::size_t firstIovec_;
+            std::size_t numIovecs_;
+            std::uint64_t offset_;
+            std::size_t size_;
+        };
+
+        maniscalco::m99_async_writer::request_type request_;
+        std::size_t size_;
+        std::vector<iovec> iovecs_;
+        std::vector<chunk_type> chunks_;
+        std::size_t remaining_;     // chunks not yet complete
+    };
+
+
+    //==================================================================================================================
+    std::unique_ptr<in_flight_type> make_in_flight
+    (
+        maniscalco::m99_async_writer::request_type request,
+        std::uint64_t offset
+    )
+    {
+        auto inFlight = std::make_unique<in_flight_type>();
+        inFlight->size_ = request.size();
+        inFlight->request_ = std::move(request);
+        auto & iovecs = inFlight->iovecs_;
+        if (!inFlight->request_.head_.empty())
+            iovecs.push_back({inFlight->request_.head_.data(), inFlight->request_.head_.size()});
+        for (auto [data, size] : inFlight->request_.segments_)
+            if (size > 0)
+                iovecs.push_back({(void *)data, size});
+        for (std::size_t first = 0; first < iovecs.size(); first += max_iovecs)
+        {
+            auto count = std::min<std::size_t>(iovecs.size() - first, max_iovecs);
+            std::size_t size = 0;
+            for (std::size_t i = first; i < (first + count); ++i)
+                size += iovecs[i].iov_len;
+            inFlight->chunks_.push_back({inFlight.get(), first, count, offset, size});
+            offset += size;
+        }
+        inFlight->remaining_ = inFlight->chunks_.size();
+        return inFlight;
+    }
+
+} // namespace
+
+
+#if defined(M99_IO_URING)
+
+    // a minimal io_uring (submission and completion rings) driven directly through the system calls
+    struct maniscalco::m99_async_writer::ring_type
+    {
+        //==============================================================================================================
+        bool open
+        (
+            unsigned entries
+        )
+        {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            fileDescriptor_ = (int)::syscall(__NR_io_uring_setup, entries, &params);
+            if (fileDescriptor_ < 0)
+                return false;
+            sqRingSize_ = (params.sq_off.array + (params.sq_entries * sizeof(unsigned)));
+            cqRingSize_ = (params.cq_off.cqes + (params.cq_entries * sizeof(io_uring_cqe)));
+            auto singleMap = ((params.features & IORING_FEAT_SINGLE_MMAP) != 0);
+            if (singleMap)
+                sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+            sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fileDescriptor_, IORING_OFF_SQ_RING);
+            if (sqRing_ == MAP_FAILED)
+                return false;
+            cqRing_ = singleMap ? sqRing_ : ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fileDescriptor_, IORING_OFF_CQ_RING);
+            if (cqRing_ == MAP_FAILED)
+                return false;
+            sqesSize_ = (params.sq_entries * sizeof(io_uring_sqe));
+            auto sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fileDescriptor_, IORING_OFF_SQES);
+            if (sqes == MAP_FAILED)
+                return false;
+            sqes_ = (io_uring_sqe *)sqes;
+
+            auto sqRing = (std::uint8_t *)sqRing_;
+            sqTail_ = (unsigned *)(sqRing + params.sq_off.tail);
+            sqMask_ = *(unsigned *)(sqRing + params.sq_off.ring_mask);
+            sqArray_ = (unsigned *)(sqRing + params.sq_off.array);
+            auto cqRing = (std::uint8_t *)cqRing_;
+            cqHead_ = (unsigned *)(cqRing + params.cq_off.head);
+            cqTail_ = (unsigned *)(cqRing + params.cq_off.tail);
+            cqMask_ = *(unsigned *)(cqRing + params.cq_off.ring_mask);
+            cqes_ = (io_uring_cqe *)(cqRing + params.cq_off.cqes);
+            capacity_ = params.sq_entries;
+            return true;
+        }
+
+
+        //==============================================================================================================
+        ~ring_type
+        (
+        )
+        {
+            if (sqes_ != nullptr)
+                ::munmap(sqes_, sqesSize_);
+            if ((cqRing_ != nullptr) && (cqRing_ != MAP_FAILED) && (cqRing_ != sqRing_))
+                ::munmap(cqRing_, cqRingSize_);
+            if ((sqRing_ != nullptr) && (sqRing_ != MAP_FAILED))
+                ::munmap(sqRing_, sqRingSize_);
+            if (fileDescriptor_ >= 0)
+                ::close(fileDescriptor_);
+        }
+
+
+        //==============================================================================================================
+        bool full
+        (
+        ) const
+        {
+            return (numInFlight_ >= capacity_);
+        }
+
+
+        //==============================================================================================================
+        bool submit
+        (
+            // submits a positional writev.  the caller ensures that the ring is not full.  the entry belongs to the
+            // kernel once it is in the ring so it is counted as in flight even if io_uring_enter fails (in which
+            // case it is submitted by the next call to enter) and its memory must not be released until it is
+            // reaped.
+            int fileDescriptor,
+            iovec const * iovecs,
+            std::size_t numIovecs,
+            std::uint64_t offset,
+            void * userData
+        )
+        {
+            // only this thread produces submissions so the tail needs no atomic read
+            auto tail = *sqTail_;
+            auto index = (tail & sqMask_);
+            auto & sqe = sqes_[index];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_WRITEV;
+            sqe.fd = fileDescriptor;
+            sqe.addr = (std::uint64_t)iovecs;
+            sqe.len = (std::uint32_t)numIovecs;
+            sqe.off = offset;
+            sqe.user_data = (std::uint64_t)userData;
+            sqArray_[index] = index;
+            __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+            ++numInFlight_;
+            ++numUnsubmitted_;
+            return enter(0);
+        }
+
+
+        //==============================================================================================================
+        bool enter
+        (
+            // submits any entries still in the ring and waits for at least 'minComplete' completions
+            unsigned minComplete
+        )
+        {
+            while (true)
+            {
+                auto submitted = ::syscall(__NR_io_uring_enter, fileDescriptor_, numUnsubmitted_, minComplete,
+                        (minComplete > 0) ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+                if (submitted >= 0)
+                {
+                    numUnsubmitted_ -= submitted;
+                    return true;
+                }
+                if (errno != EINTR)
+                    return false;
+            }
+        }
+
+
+        //==============================================================================================================
+        template <typename function_type>
+        bool wait
+        (
+            // waits for at least one write to complete and then passes each completed write's user data and
+            // result to 'complete'
+            function_type complete
+        )
+        {
+            if (!enter(1))
+                return false;
+            auto head = *cqHead_;
+            auto tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head)
+            {
+                auto const & cqe = cqes_[head & cqMask_];
+                --numInFlight_;
+                complete((void *)cqe.user_data, cqe.res);
+            }
+            __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+            return true;
+        }
+
+        int fileDescriptor_{-1};
+
+        void * sqRing_{nullptr};
+
+        void * cqRing_{nullptr};
+
+        std::size_t sqRingSize_{0};
+
+        std::size_t cqRingSize_{0};
+
+        std::size_t sqesSize_{0};
+
+        io_uring_sqe * sqes_{nullptr};
+
+        unsigned * sqTail_{nullptr};
+
+        unsigned sqMask_{0};
+
+        unsigned * sqArray_{nullptr};
+
+        unsigned * cqHead_{nullptr};
+
+        unsigned * cqTail_{nullptr};
+
+        unsigned cqMask_{0};
+
+        io_uring_cqe * cqes_{nullptr};
+
+        std::size_t capacity_{0};
+
+        std::size_t numInFlight_{0};
+
+        std::size_t numUnsubmitted_{0};     // entries in the ring which the kernel has not yet taken
+    };
+
+#else
+
+    // io_uring is not available.  the ring is never created so this is only ever destroyed as a null pointer.
+    struct maniscalco::m99_async_writer::ring_type
+    {
+    };
+
+#endif
+
+
+//======================================================================================================================
+std::size_t maniscalco::m99_async_writer::request_type::size
+(
+) const
+{
+    auto size = head_.size();
+    for (auto const & segment : segments_)
+        size += segment.size_;
+    return size;
+}
+
+
+//======================================================================================================================
+maniscalco::m99_async_writer::m99_async_writer
+(
+    // writes begin at the descriptor's current position.  the descriptor is not closed by the writer.
+    int fileDescriptor,
+    configuration_type const & configuration
+):
+    fileDescriptor_(fileDescriptor),
+    configuration_({.queueDepth_ = std::max<std::size_t>(configuration.queueDepth_, 1),
+            .maxBytesInFlight_ = configuration.maxBytesInFlight_, .useIoUring_ = configuration.useIoUring_})
+{
+    // writes at explicit offsets need a seekable output which is not in append mode (where the kernel ignores
+    // the offset).  anything else (a pipe, a terminal) is written in order at its current position.
+    auto position = ::lseek(fileDescriptor_, 0, SEEK_CUR);
+    auto flags = ::fcntl(fileDescriptor_, F_GETFL);
+    seekable_ = ((position >= 0) && (flags >= 0) && ((flags & O_APPEND) == 0));
+    offset_ = seekable_ ? position : 0;
+
+    #if defined(M99_IO_URING)
+        // several writes of different requests may be in flight at once so the ring is sized for a few chunks
+        // per request
+        if (configuration_.useIoUring_ && seekable_)
+        {
+            ring_ = std::make_unique<ring_type>();
+            if (!ring_->open(std::clamp<unsigned>(configuration_.queueDepth_ * 4, 8, 4096)))
+                ring_.reset();
+        }
+    #endif
+
+    thread_ = std::thread([this](){run();});
+}
+
+
+//======================================================================================================================
+maniscalco::m99_async_writer::~m99_async_writer
+(
+)
+{
+    close();
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_async_writer::write
+(
+    // queues the request and returns without waiting for it to be written unless the limits on writes in flight
+    // have been reached.  returns false (and discards the request) if an earlier write failed or the writer is
+    // closed.
+    request_type request
+)
+{
+    auto size = request.size();
+    {
+        std::unique_lock uniqueLock(mutex_);
+        notFull_.wait(uniqueLock, [&]()
+                {
+                    return (closed_ || failed_ || ((numOutstanding_ < configuration_.queueDepth_) &&
+                            ((bytesOutstanding_ == 0) || ((bytesOutstanding_ + size) <= configuration_.maxBytesInFlight_))));
+                });
+        if (closed_ || failed_)
+            return false;
+        queue_.push_back(std::move(request));
+        ++numOutstanding_;
+        bytesOutstanding_ += size;
+    }
+    notEmpty_.notify_one();
+    return true;
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_async_writer::close
+(
+    // waits for every write to complete.  returns false if any write failed.
+)
+{
+    {
+        std::lock_guard lockGuard(mutex_);
+        closed_ = true;
+    }
+    notEmpty_.notify_all();
+    notFull_.notify_all();
+    if (thread_.joinable())
+        thread_.join();
+    return !failed_;
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_async_writer::uses_io_uring
+(
+) const
+{
+    return (ring_ != nullptr);
+}
+
+
+//======================================================================================================================
+void maniscalco::m99_async_writer::complete
+(
+    std::size_t size
+)
+{
+    {
+        std::lock_guard lockGuard(mutex_);
+        --numOutstanding_;
+        bytesOutstanding_ -= size;
+    }
+    notFull_.notify_all();
+}
+
+
+//======================================================================================================================
+void maniscalco::m99_async_writer::run
+(
+    // the writer thread.  requests are taken in order and each is assigned the next offset within the output so
+    // the order in which the writes complete does not matter.  after a failure the remaining requests are discarded.
+)
+{
+    std::vector<std::unique_ptr<in_flight_type>> inFlight;
+    auto finish = [&](in_flight_type * owner)
+            {
+                auto iter = std::find_if(inFlight.begin(), inFlight.end(), [&](auto const & entry){return (entry.get() == owner);});
+                auto finished = std::move(*iter);
+                inFlight.erase(iter);
+                complete(finished->size_);
+            };
+    #if defined(M99_IO_URING)
+        // reaps completed chunks.  a short write (unusual for a regular file) is finished synchronously.
+        auto reap = [&]()
+                {
+                    auto waited = ring_->wait([&](void * userData, std::int32_t result)
+                            {
+                                auto chunk = (in_flight_type::chunk_type *)userData;
+                                auto owner = chunk->owner_;
+                                if (result < 0)
+                                {
+                                    failed_ = true;
+                                }
+                                else if ((std::size_t)result < chunk->size_)
+                                {
+                                    auto iovecs = (owner->iovecs_.data() + chunk->firstIovec_);
+                                    auto numIovecs = chunk->numIovecs_;
+                                    consume(iovecs, numIovecs, result);
+                                    if (!write_fully(fileDescriptor_, true, chunk->offset_ + result, iovecs, numIovecs))
+                                        failed_ = true;
+                                }
+                                if (--owner->remaining_ == 0)
+                                    finish(owner);
+                            });
+                    if (!waited)
+                        failed_ = true;
+                    return waited;
+                };
+    #endif
+
+    while (true)
+    {
+        // while writes are in flight the thread waits for completions rather than for further requests
+        std::optional<request_type> request;
+        {
+            std::unique_lock uniqueLock(mutex_);
+            if (inFlight.empty())
+                notEmpty_.wait(uniqueLock, [&](){return (closed_ || !queue_.empty());});
+            if (!queue_.empty())
+            {
+                request.emplace(std::move(queue_.front()));
+                queue_.pop_front();
+            }
+            else if (inFlight.empty())
+            {
+                break;
+            }
+        }
+
+        if (!request)
+        {
+            #if defined(M99_IO_URING)
+                if (!reap())
+                    break;
+            #endif
+            continue;
+        }
+
+        auto size = request->size();
+        inFlight.push_back(make_in_flight(std::move(*request), offset_));
+        offset_ += size;
+        auto current = inFlight.back().get();
+        if (failed_)
+        {
+            finish(current);
+            continue;
+        }
+
+        #if defined(M99_IO_URING)
+            if (ring_)
+            {
+                for (auto & chunk : current->chunks_)
+                {
+                    while (ring_->full() && reap())
+                        ;
+                    // chunks which are never submitted are accounted for here.  a chunk whose submission failed is
+                    // still in the ring and is reaped like any other.
+                    auto chunksEnd = (current->chunks_.data() + current->chunks_.size());
+                    if (failed_)
+                    {
+                        current->remaining_ -= std::distance(&chunk, chunksEnd);
+                        break;
+                    }
+                    if (!ring_->submit(fileDescriptor_, current->iovecs_.data() + chunk.firstIovec_, chunk.numIovecs_, chunk.offset_, &chunk))
+                    {
+                        failed_ = true;
+                        current->remaining_ -= std::distance(&chunk + 1, chunksEnd);
+                        break;
+                    }
+                }
+                if (current->remaining_ == 0)
+                    finish(current);
+                continue;
+            }
+        #endif
+
+        if (!write_fully(fileDescriptor_, seekable_, current->chunks_.empty() ? 0 : current->chunks_.front().offset_,
+                current->iovecs_.data(), current->iovecs_.size()))
+            failed_ = true;
+        finish(current);
+    }
+
+    #if defined(M99_IO_URING)
+        // the kernel may still read the iovecs and buffers of writes in flight so they are drained before they are
+        // released.  if even that fails they are leaked rather than freed beneath the kernel.
+        while ((!inFlight.empty()) && reap())
+            ;
+        for (auto & entry : inFlight)
+            entry.release();
+    #endif
+
+    // a failure leaves requests in the queue which are discarded so that waiting writers are released
+    std::lock_guard lockGuard(mutex_);
+    queue_.clear();
+    numOutstanding_ = 0;
+    bytesOutstanding_ = 0;
+    notFull_.notify_all();
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "./m99_buffer_pool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace maniscalco
+{
+
+    // writes to a file descriptor from a thread of its own so that the threads which produce the data never wait
+    // for storage.  when the output is seekable and io_uring is available (linux) several writes are kept in flight
+    // at once, each at its own offset.  otherwise the writes are made one at a time with pwritev (writev for a pipe).
+    // either way the data reaches the output in the order in which it was submitted.
+    class m99_async_writer
+    {
+    public:
+
+        struct configuration_type
+        {
+            // the most writes which may be submitted but not yet complete.  a further write waits for one to complete.
+            std::size_t queueDepth_{8};
+            // the most bytes which may be submitted but not yet written.  a write which would exceed this waits for
+            // earlier writes to complete (a single larger write is accepted when nothing else is in flight).
+            std::size_t maxBytesInFlight_{1ull << 28};
+            // fall back to pwritev when false
+            bool useIoUring_{true};
+        };
+
+        // a single write.  'head_' (headers and the like) is written first and is followed by each segment in order.
+        // the segments typically lie within 'buffers_' which are released once the write completes.
+        struct request_type
+        {
+            struct segment_type
+            {
+                std::uint8_t const * data_;
+                std::size_t size_;
+            };
+
+            std::size_t size() const;
+
+            std::vector<std::uint8_t> head_;
+            std::vector<segment_type> segments_;
+            std::vector<m99_buffer_pool::buffer_type> buffers_;
+        };
+
+        m99_async_writer
+        (
+            int,
+            configuration_type const &
+        );
+
+        m99_async_writer(m99_async_writer const &) = delete;
+
+        m99_async_writer & operator = (m99_async_writer const &) = delete;
+
+        ~m99_async_writer();
+
+        bool write
+        (
+            request_type
+        );
+
+        bool close();
+
+        bool uses_io_uring() const;
+
+    private:
+
+        struct ring_type;
+
+        void run();
+
+        void complete
+        (
+            std::size_t
+        );
+
+        int const fileDescriptor_;
+
+        configuration_type const configuration_;
+
+        bool seekable_{false};
+
+        std::uint64_t offset_{0};
+
+        std::unique_ptr<ring_type> ring_;
+
+        std::mutex mutex_;
+
+        std::condition_variable notEmpty_;
+
+        std::condition_variable notFull_;
+
+        std::deque<request_type> queue_;
+
+        std::size_t numOutstanding_{0};     // queued or in flight
+
+        std::size_t bytesOutstanding_{0};
+
+        bool closed_{false};
+
+        std::atomic<bool> failed_{false};
+
+        std::thread thread_;
+    };
+
+} // namespace maniscalco
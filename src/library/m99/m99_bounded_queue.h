@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+
+namespace maniscalco
+{
+
+    // blocking FIFO of at most 'capacity' items connecting the stages of a pipeline.  the bound keeps a fast
+    // producer from running ahead of a slow consumer so the memory held by a pipeline is fixed.  a capacity of zero
+    // hands each item directly from push to pop: push returns once the item has been taken so no item waits
+    // between the stages.  closing the queue ends the pipeline: pop drains what remains and then returns nothing,
+    // push fails.
+    template <typename T>
+    class m99_bounded_queue
+    {
+    public:
+
+        m99_bounded_queue
+        (
+            std::size_t
+        );
+
+        bool push
+        (
+            T
+        );
+
+        std::optional<T> pop();
+
+        void close();
+
+    private:
+
+        std::size_t const capacity_;
+
+        std::mutex mutex_;
+
+        std::condition_variable notEmpty_;
+
+        std::condition_variable notFull_;
+
+        std::condition_variable taken_;     // a direct handoff is complete
+
+        std::deque<T> queue_;
+
+        std::size_t numPushed_{0};
+
+        std::size_t numPopped_{0};
+
+        bool closed_{false};
+    };
+
+} // namespace maniscalco
+
+
+//======================================================================================================================
+template <typename T>
+maniscalco::m99_bounded_queue<T>::m99_bounded_queue
+(
+    std::size_t capacity
+):
+    capacity_(capacity)
+{
+}
+
+
+//======================================================================================================================
+template <typename T>
+bool maniscalco::m99_bounded_queue<T>::push
+(
+    // blocks while the queue is full (or, for a capacity of zero, until the item is taken).  returns false (and
+    // discards the item) if the queue is closed.
+    T item
+)
+{
+    std::unique_lock uniqueLock(mutex_);
+    notFull_.wait(uniqueLock, [&](){return (closed_ || (queue_.size() < std::max<std::size_t>(capacity_, 1)));});
+    if (closed_)
+        return false;
+    queue_.push_back(std::move(item));
+    auto ticket = ++numPushed_;
+    notEmpty_.notify_one();
+    if (capacity_ == 0)
+        taken_.wait(uniqueLock, [&](){return (closed_ || (numPopped_ >= ticket));});
+    return true;
+}
+
+
+//======================================================================================================================
+template <typename T>
+auto maniscalco::m99_bounded_queue<T>::pop
+(
+    // blocks while the queue is empty.  returns nothing once the queue is closed and empty.
+) -> std::optional<T>
+{
+    std::unique_lock uniqueLock(mutex_);
+    notEmpty_.wait(uniqueLock, [&](){return (closed_ || !queue_.empty());});
+    if (queue_.empty())
+        return std::nullopt;
+    std::optional<T> item(std::move(queue_.front()));
+    queue_.pop_front();
+    ++numPopped_;
+    notFull_.notify_one();
+    taken_.notify_all();
+    return item;
+}
+
+
+//======================================================================================================================
+template <typename T>
+void maniscalco::m99_bounded_queue<T>::close
+(
+)
+{
+    std::lock_guard lockGuard(mutex_);
+    closed_ = true;
+    notEmpty_.notify_all();
+    notFull_.notify_all();
+    taken_.notify_all();
+}
@@ -0,0 +1,188 @@
+#include "./m99_buffer_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+#if defined(__linux__)
+    #include <sys/mman.h>
+#endif
+
+
+namespace
+{
+
+    static auto constexpr page_size = (1ull << 12);
+    static auto constexpr huge_page_size = (1ull << 21);
+
+} // namespace
+
+
+//======================================================================================================================
+maniscalco::m99_buffer_pool::buffer_type::buffer_type
+(
+    m99_buffer_pool * bufferPool,
+    std::uint8_t * data,
+    std::size_t size,
+    std::size_t capacity
+):
+    bufferPool_(bufferPool),
+    data_(data),
+    size_(size),
+    capacity_(capacity)
+{
+}
+
+
+//======================================================================================================================
+maniscalco::m99_buffer_pool::buffer_type::buffer_type
+(
+    buffer_type && other
+):
+    bufferPool_(std::exchange(other.bufferPool_, nullptr)),
+    data_(std::exchange(other.data_, nullptr)),
+    size_(std::exchange(other.size_, 0)),
+    capacity_(std::exchange(other.capacity_, 0))
+{
+}
+
+
+//======================================================================================================================
+auto maniscalco::m99_buffer_pool::buffer_type::operator =
+(
+    buffer_type && other
+) -> buffer_type &
+{
+    if (this != &other)
+    {
+        release();
+        bufferPool_ = std::exchange(other.bufferPool_, nullptr);
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        capacity_ = std::exchange(other.capacity_, 0);
+    }
+    return *this;
+}
+
+
+//======================================================================================================================
+maniscalco::m99_buffer_pool::buffer_type::~buffer_type
+(
+)
+{
+    release();
+}
+
+
+//======================================================================================================================
+std::uint8_t * maniscalco::m99_buffer_pool::buffer_type::data
+(
+) const
+{
+    return data_;
+}
+
+
+//======================================================================================================================
+std::size_t maniscalco::m99_buffer_pool::buffer_type::size
+(
+) const
+{
+    return size_;
+}
+
+
+//======================================================================================================================
+void maniscalco::m99_buffer_pool::buffer_type::release
+(
+)
+{
+    // return the buffer to the pool
+    if (bufferPool_ != nullptr)
+        bufferPool_->release(data_, capacity_);
+    bufferPool_ = nullptr;
+    data_ = nullptr;
+    size_ = 0;
+    capacity_ = 0;
+}
+
+
+//======================================================================================================================
+maniscalco::m99_buffer_pool::m99_buffer_pool
+(
+):
+    m99_buffer_pool(configuration_type{})
+{
+}
+
+
+//======================================================================================================================
+maniscalco::m99_buffer_pool::m99_buffer_pool
+(
+    configuration_type const & configuration
+):
+    configuration_(configuration)
+{
+}
+
+
+//======================================================================================================================
+maniscalco::m99_buffer_pool::~m99_buffer_pool
+(
+)
+{
+    // all buffers must have been released by now
+    for (auto [data, capacity] : available_)
+        std::free(data);
+}
+
+
+//======================================================================================================================
+auto maniscalco::m99_buffer_pool::acquire
+(
+    // returns a buffer of at least 'size' bytes.  the smallest available buffer which is large enough is reused
+    // if there is one.  otherwise a new buffer is allocated (page aligned or, when huge pages are enabled and the
+    // buffer is large enough to benefit, huge page aligned).  the contents of the buffer are unspecified.
+    std::size_t size
+) -> buffer_type
+{
+    {
+        std::lock_guard lockGuard(mutex_);
+        auto bestFit = available_.end();
+        for (auto iter = available_.begin(); iter != available_.end(); ++iter)
+            if ((iter->capacity_ >= size) && ((bestFit == available_.end()) || (iter->capacity_ < bestFit->capacity_)))
+                bestFit = iter;
+        if (bestFit != available_.end())
+        {
+            auto [data, capacity] = *bestFit;
+            *bestFit = available_.back();
+            available_.pop_back();
+            return buffer_type(this, data, size, capacity);
+        }
+    }
+
+    auto useHugePages = (configuration_.useHugePages_ && (size >= huge_page_size));
+    auto alignment = useHugePages ? huge_page_size : page_size;
+    auto capacity = std::max<std::size_t>(((size + alignment - 1) / alignment) * alignment, alignment);
+    auto data = (std::uint8_t *)std::aligned_alloc(alignment, capacity);
+    if (data == nullptr)
+        throw std::bad_alloc();
+    #if defined(__linux__) && defined(MADV_HUGEPAGE)
+        if (useHugePages)
+            ::madvise(data, capacity, MADV_HUGEPAGE);
+    #endif
+    return buffer_type(this, data, size, capacity);
+}
+
+
+//======================================================================================================================
+void maniscalco::m99_buffer_pool::release
+(
+    std::uint8_t * data,
+    std::size_t capacity
+)
+{
+    std::lock_guard lockGuard(mutex_);
+    available_.push_back({data, capacity});
+}
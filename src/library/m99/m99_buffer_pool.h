@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+
+namespace maniscalco
+{
+
+    // thread safe pool of large buffers.  buffers are returned to the pool when released rather than freed so
+    // a long running process which repeatedly encodes or decodes blocks reaches a steady state in which no memory
+    // is allocated and no pages are faulted in.
+    class m99_buffer_pool
+    {
+    public:
+
+        struct configuration_type
+        {
+            // advise the kernel to back large buffers with transparent huge pages (linux only)
+            bool useHugePages_{false};
+        };
+
+        class buffer_type
+        {
+        public:
+
+            buffer_type() = default;
+
+            buffer_type(buffer_type &&);
+
+            buffer_type & operator = (buffer_type &&);
+
+            ~buffer_type();
+
+            std::uint8_t * data() const;
+
+            std::size_t size() const;
+
+            void release();
+
+        private:
+
+            friend class m99_buffer_pool;
+
+            buffer_type
+            (
+                m99_buffer_pool *,
+                std::uint8_t *,
+                std::size_t,
+                std::size_t
+            );
+
+            m99_buffer_pool * bufferPool_{nullptr};
+
+            std::uint8_t * data_{nullptr};
+
+            std::size_t size_{0};
+
+            std::size_t capacity_{0};
+        };
+
+        m99_buffer_pool();
+
+        m99_buffer_pool
+        (
+            configuration_type const &
+        );
+
+        m99_buffer_pool(m99_buffer_pool const &) = delete;
+
+        m99_buffer_pool & operator = (m99_buffer_pool const &) = delete;
+
+        ~m99_buffer_pool();
+
+        buffer_type acquire
+        (
+            std::size_t
+        );
+
+    private:
+
+        struct allocation
+        {
+            std::uint8_t *  data_;
+            std::size_t     capacity_;
+        };
+
+        void release
+        (
+            std::uint8_t *,
+            std::size_t
+        );
+
+        configuration_type configuration_;
+
+        std::mutex mutex_;
+
+        std::vector<allocation> available_;
+
+    };
+
+} // namespace maniscalco
@@ -0,0 +1,193 @@
+#include "./m99_crc32c.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__SSE4_2__)
+    #include <nmmintrin.h>
+#endif
+
+
+namespace
+{
+
+    // reflected CRC32C polynomial
+    static auto constexpr polynomial = 0x82f63b78u;
+
+    #if defined(__SSE4_2__)
+
+        using shift_table = std::array<std::array<std::uint32_t, 256>, 4>;
+
+
+        //==============================================================================================================
+        std::uint32_t gf2_matrix_times
+        (
+            std::uint32_t const * matrix,
+            std::uint32_t vector
+        )
+        {
+            std::uint32_t sum = 0;
+            for (; vector != 0; vector >>= 1, ++matrix)
+                if (vector & 1)
+                    sum ^= *matrix;
+            return sum;
+        }
+
+
+        //==============================================================================================================
+        void gf2_matrix_square
+        (
+            std::uint32_t * square,
+            std::uint32_t const * matrix
+        )
+        {
+            for (auto n = 0; n < 32; ++n)
+                square[n] = gf2_matrix_times(matrix, matrix[n]);
+        }
+
+
+        //==============================================================================================================
+        shift_table make_shift_table
+        (
+            // tables which apply 'length' zero bytes to a crc (length must be a power of two).  these are used to
+            // combine the crcs of independent streams which are computed in parallel.
+            std::size_t length
+        )
+        {
+            std::uint32_t even[32];
+            std::uint32_t odd[32];
+            odd[0] = polynomial;
+            for (auto n = 1; n < 32; ++n)
+                odd[n] = (1u << (n - 1));
+            gf2_matrix_square(even, odd);   // two zero bits
+            gf2_matrix_square(odd, even);   // four zero bits
+            auto op = odd;
+            while (true)
+            {
+                gf2_matrix_square(even, odd);
+                op = even;
+                if ((length >>= 1) == 0)
+                    break;
+                gf2_matrix_square(odd, even);
+                op = odd;
+                if ((length >>= 1) == 0)
+                    break;
+            }
+
+            shift_table shiftTable;
+            for (std::uint32_t n = 0; n < 256; ++n)
+                for (auto i = 0; i < 4; ++i)
+                    shiftTable[i][n] = gf2_matrix_times(op, n << (i * 8));
+            return shiftTable;
+        }
+
+
+        //==============================================================================================================
+        inline std::uint32_t shift
+        (
+            shift_table const & shiftTable,
+            std::uint32_t crc
+        )
+        {
+            return (shiftTable[0][crc & 0xff] ^ shiftTable[1][(crc >> 8) & 0xff] ^ shiftTable[2][(crc >> 16) & 0xff] ^ shiftTable[3][crc >> 24]);
+        }
+
+
+        static auto constexpr long_stream_size = 8192;
+        static auto constexpr short_stream_size = 256;
+
+
+        //==============================================================================================================
+        inline std::uint64_t load
+        (
+            std::uint8_t const * source
+        )
+        {
+            std::uint64_t value;
+            std::memcpy(&value, source, sizeof(value));
+            return value;
+        }
+
+
+        //==============================================================================================================
+        template <std::size_t stream_size>
+        inline std::uint8_t const * crc32c_three_streams
+        (
+            // the crc32 instruction has a latency of three cycles and a throughput of one per cycle so three
+            // independent streams of 'stream_size' bytes are computed together and then combined.
+            std::uint8_t const * current,
+            std::size_t & size,
+            std::uint64_t & crc,
+            shift_table const & shiftTable
+        )
+        {
+            while (size >= (stream_size * 3))
+            {
+                std::uint64_t crc1 = 0;
+                std::uint64_t crc2 = 0;
+                for (auto end = (current + stream_size); current < end; current += 8)
+                {
+                    crc = _mm_crc32_u64(crc, load(current));
+                    crc1 = _mm_crc32_u64(crc1, load(current + stream_size));
+                    crc2 = _mm_crc32_u64(crc2, load(current + (stream_size * 2)));
+                }
+                crc = (shift(shiftTable, crc) ^ crc1);
+                crc = (shift(shiftTable, crc) ^ crc2);
+                current += (stream_size * 2);
+                size -= (stream_size * 3);
+            }
+            return current;
+        }
+
+    #else
+
+        //==============================================================================================================
+        std::array<std::uint32_t, 256> make_byte_table
+        (
+        )
+        {
+            std::array<std::uint32_t, 256> byteTable;
+            for (std::uint32_t n = 0; n < 256; ++n)
+            {
+                auto crc = n;
+                for (auto i = 0; i < 8; ++i)
+                    crc = ((crc >> 1) ^ ((crc & 1) ? polynomial : 0));
+                byteTable[n] = crc;
+            }
+            return byteTable;
+        }
+
+    #endif
+
+} // namespace
+
+
+//======================================================================================================================
+std::uint32_t maniscalco::m99_crc32c
+(
+    void const * data,
+    std::size_t size,
+    std::uint32_t crc
+)
+{
+    auto current = (std::uint8_t const *)data;
+    #if defined(__SSE4_2__)
+        static shift_table const longShiftTable = make_shift_table(long_stream_size);
+        static shift_table const shortShiftTable = make_shift_table(short_stream_size);
+
+        std::uint64_t crc0 = ~crc;
+        current = crc32c_three_streams<long_stream_size>(current, size, crc0, longShiftTable);
+        current = crc32c_three_streams<short_stream_size>(current, size, crc0, shortShiftTable);
+        for (; size >= 8; size -= 8, current += 8)
+            crc0 = _mm_crc32_u64(crc0, load(current));
+        for (; size > 0; --size)
+            crc0 = _mm_crc32_u8(crc0, *current++);
+        return ~(std::uint32_t)crc0;
+    #else
+        static auto const byteTable = make_byte_table();
+        crc = ~crc;
+        for (; size > 0; --size)
+            crc = (byteTable[(crc ^ *current++) & 0xff] ^ (crc >> 8));
+        return ~crc;
+    #endif
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+
+namespace maniscalco
+{
+
+    // CRC32C (Castagnoli).  uses the SSE4.2 crc32 instruction when available.  'crc' is the checksum
+    // of any preceding data so that a checksum can be computed incrementally.
+    std::uint32_t m99_crc32c
+    (
+        void const *,
+        std::size_t,
+        std::uint32_t = 0
+    );
+
+} // namespace maniscalco
@@ -1,6 +1,19 @@
 #include "./m99_decode.h"
+#include "./m99_adaptive_coder.h"
+#include "./m99_run_length.h"
+#include "./m99_thread_pool.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
 #include <fstream>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX512BW__) || defined(__BMI2__)
+    #include <immintrin.h>
+#endif
 
 
 namespace
@@ -10,12 +23,76 @@ namespace
     struct symbol_info
     {
         symbol_info(){}
-        symbol_info(std::uint8_t symbol, std::uint32_t count):symbol_(symbol), count_(count){}
-        std::uint8_t    symbol_;
+        symbol_info(std::uint32_t symbol, std::uint32_t count):symbol_(symbol), count_(count){}
+        std::uint32_t   symbol_;
         std::uint32_t   count_;
     };
 
 
+    template <typename symbol_type>
+    static auto constexpr alphabet_size = (1ull << (sizeof(symbol_type) * 8));
+
+    struct tiny_decode_table_entry_type
+    {
+        std::uint32_t left_;
+        std::uint32_t length_;
+    };
+
+    static auto constexpr tiny_decode_peek_length = 3;
+
+    // indexed by [maxLeft][maxRight][total][next three bits of the stream] for all totals less than 8.
+    // the entry holds the decoded left value and the number of bits that the code actually occupies.
+    using tiny_decode_table_type = tiny_decode_table_entry_type[8][8][8][1 << tiny_decode_peek_length];
+
+
+    tiny_decode_table_type tinyDecodeTable;
+    auto const initialize = []
+    (
+        tiny_decode_table_type & result
+    ) -> bool
+    {
+        for (std::uint32_t maxLeft = 0; maxLeft < 8; ++maxLeft)
+        {
+            for (std::uint32_t maxRight = 0; maxRight < 8; ++maxRight)
+            {
+                for (std::uint32_t total = 0; total < 8; ++total)
+                {
+                    for (std::uint32_t peek = 0; peek < (1 << tiny_decode_peek_length); ++peek)
+                    {
+                        std::uint32_t t = total;
+                        std::uint32_t ml = maxLeft;
+                        std::uint32_t mr = maxRight;
+                        if (t > ml)
+                        {
+                            std::uint32_t inferredRight = (t - ml);
+                            mr -= inferredRight;
+                            t -= inferredRight;
+                        }
+                        std::uint32_t left = 0;
+                        if (t > mr)
+                        {
+                            left = (t - mr);
+                            t -= left;
+                        }
+                        std::uint32_t length = 0;
+                        if (t)
+                        {
+                            std::uint32_t codeLength = (31 - __builtin_clz(t));
+                            std::uint32_t code = (peek >> (tiny_decode_peek_length - codeLength));
+                            length = codeLength;
+                            if ((code | (1ull << codeLength)) <= t)
+                                code |= (((peek >> (tiny_decode_peek_length - ++length)) & 1) << codeLength);
+                            left += code;
+                        }
+                        result[maxLeft][maxRight][total][peek] = {left, length};
+                    }
+                }
+            }
+        }
+        return true;
+    }(tinyDecodeTable);
+
+
     //======================================================================================================================
     std::uint32_t unpack_value
     (
@@ -25,6 +102,13 @@ namespace
         std::uint32_t maxRight
     )
     {
+        if (total < 8)
+        {
+            auto const & decTableEntry = tinyDecodeTable[(maxLeft >= 8) ? 7 : maxLeft][(maxRight >= 8) ? 7 : maxRight]
+                    [total][decodeStream.peek(tiny_decode_peek_length)];
+            decodeStream.consume(decTableEntry.length_);
+            return decTableEntry.left_;
+        }
         if (total > maxLeft)
         {
             auto inferredRight = (total - maxLeft);
@@ -39,12 +123,16 @@ namespace
         }
         if (total)
         {
-            std::uint32_t codeLength = 1;
-            while (total >> ++codeLength)
-                ;
-            auto code = decodeStream.pop(--codeLength);
-            if (((code | (1ull << codeLength)) <= total))
-                code |= (decodeStream.pop_bit() << codeLength);
+            // read the code and its (possible) msb in one peek.  consume only the bits that the code occupies.
+            std::uint32_t codeLength = (31 - __builtin_clz(total));
+            auto bits = decodeStream.peek(codeLength + 1);
+            std::uint32_t code = (bits >> 1);
+            if ((code | (1ull << codeLength)) <= total)
+            {
+                code |= ((bits & 1) << codeLength);
+                ++codeLength;
+            }
+            decodeStream.consume(codeLength);
             left += code;
         }    
         return left;
@@ -52,40 +140,183 @@ namespace
 
 
     //======================================================================================================================
-    void split
+    std::uint32_t unpack_value
     (
         m99_decode_stream & decodeStream,
-        std::uint8_t * decodedData,
-        std::uint32_t totalSize,
-        std::uint32_t leftSize,
-        symbol_info const * parentSymbolInfo
+        std::uint32_t total,
+        std::uint32_t maxLeft,
+        std::uint32_t maxRight,
+        std::uint32_t
     )
     {
-        if (parentSymbolInfo[0].count_ >= totalSize)
+        return unpack_value(decodeStream, total, maxLeft, maxRight);
+    }
+
+
+    //======================================================================================================================
+    std::uint32_t pop_leaf_bit
+    (
+        m99_decode_stream & decodeStream,
+        std::uint32_t
+    )
+    {
+        return decodeStream.pop_bit();
+    }
+
+
+    //======================================================================================================================
+    // high ratio mode.  the tree is range coded using adaptive models.
+    struct adaptive_decode_source
+    {
+        adaptive_decode_source
+        (
+            m99_decode_stream & decodeStream
+        ):
+            decoder_(decodeStream)
         {
-            while (totalSize--)
-                *decodedData++ = parentSymbolInfo[0].symbol_;
-            return;
         }
 
-        if (totalSize <= 2)
+        m99_range_decoder   decoder_;
+        m99_adaptive_model  model_;
+        bool                corrupt_{false};    // a value was decoded which the tree can not hold
+    };
+
+
+    //======================================================================================================================
+    std::uint32_t unpack_value
+    (
+        adaptive_decode_source & source,
+        std::uint32_t total,
+        std::uint32_t maxLeft,
+        std::uint32_t maxRight,
+        std::uint32_t depth
+    )
+    {
+        if (total > maxLeft)
+        {
+            auto inferredRight = (total - maxLeft);
+            maxRight -= inferredRight;
+            total -= inferredRight;
+        }
+        std::uint32_t left = 0;
+        if (total > maxRight)
+        {
+            left = (total - maxRight);
+            total -= left;
+        }
+        if (total)
         {
-            if (totalSize == 2)
+            // a corrupt stream can decode to any value.  one outside [0, total] is replaced so that the split stays
+            // within its bounds and the stream is rejected once it is decoded.
+            auto value = source.decoder_.decode_value(source.model_, total, m99_adaptive_model::expected_value(total, maxLeft, maxRight), depth);
+            if (value > total)
             {
-                auto c = decodeStream.pop_bit();
-                decodedData[c == 1] = parentSymbolInfo[1].symbol_;
-                decodedData[c == 0] = parentSymbolInfo[0].symbol_; 
+                source.corrupt_ = true;
+                value = total;
             }
-            else
+            left += value;
+        }
+        return left;
+    }
+
+
+    //======================================================================================================================
+    std::uint32_t pop_leaf_bit
+    (
+        adaptive_decode_source & source,
+        std::uint32_t depth
+    )
+    {
+        return source.decoder_.decode_bit(source.model_.leaf_bit(depth));
+    }
+
+
+    //======================================================================================================================
+    // compact symbol lists for the split.  the split is depth first so the lists produced at depth 'd'
+    // are only needed until the subtree below them has been decoded.  each depth therefore needs just
+    // two lists (left and right) with room for min(symbolCount, maxNodeSize >> d) entries.
+    class symbol_list_arena
+    {
+    public:
+
+        static auto constexpr max_depth = 34;
+
+        void reset
+        (
+            std::uint64_t maxNodeSize,
+            std::uint32_t symbolCount
+        )
+        {
+            std::size_t size = 0;
+            for (auto depth = 0; depth < max_depth; ++depth)
             {
-                decodedData[0] = parentSymbolInfo[0].symbol_;
+                auto nodeSize = (maxNodeSize >> depth);
+                // one extra entry because split speculatively writes one entry past the end of a full list
+                auto capacity = ((nodeSize < symbolCount) ? nodeSize : symbolCount) + 1;
+                offset_[depth][0] = size;
+                offset_[depth][1] = size + capacity;
+                size += (capacity * 2);
             }
-            return;
+            if (symbolInfo_.size() < size)
+                symbolInfo_.resize(size);
         }
 
-        std::uint32_t rightSize = (totalSize - leftSize);
-        symbol_info leftSymbolInfo[256];
-        symbol_info rightSymbolInfo[256];
+        symbol_info * get
+        (
+            std::uint32_t depth,
+            std::uint32_t side
+        )
+        {
+            return (symbolInfo_.data() + offset_[depth][side]);
+        }
+
+    private:
+
+        std::vector<symbol_info> symbolInfo_;
+
+        std::size_t offset_[max_depth][2];
+
+    };
+
+} // namespace
+
+
+//======================================================================================================================
+struct maniscalco::m99_decode_context::workspace_type
+{
+    symbol_list_arena           arena_;
+    std::vector<symbol_info>    symbolInfo_;        // the header's symbol list
+};
+
+
+namespace
+{
+
+    //======================================================================================================================
+    m99_decode_context & default_context
+    (
+        // the context used by decodes which are not given one
+    )
+    {
+        static m99_decode_context context;
+        return context;
+    }
+
+
+    //======================================================================================================================
+    template <typename decode_stream_type>
+    void split_symbol_list
+    (
+        // decode how each symbol in the parent list is distributed between the left and right children
+        decode_stream_type & decodeStream,
+        symbol_info const * parentSymbolInfo,
+        std::uint32_t leftSize,
+        std::uint32_t rightSize,
+        symbol_info * leftSymbolInfo,
+        symbol_info * rightSymbolInfo,
+        std::uint32_t depth
+    )
+    {
         symbol_info * result[2] = {leftSymbolInfo, rightSymbolInfo};
         symbol_info const * currentSymbolInfo = parentSymbolInfo;
         static auto constexpr leftSide = 0;
@@ -97,7 +328,7 @@ namespace
         {
             symbol_info symbolInfo = *currentSymbolInfo++;
             auto totalCount = symbolInfo.count_;
-            auto leftCount = unpack_value(decodeStream, totalCount, leftSizeRemaining, rightSizeRemaining);
+            auto leftCount = unpack_value(decodeStream, totalCount, leftSizeRemaining, rightSizeRemaining, depth);
             auto rightCount = (totalCount - leftCount);
             leftSizeRemaining -= leftCount;
             rightSizeRemaining -= rightCount;
@@ -113,41 +344,509 @@ namespace
             n -= currentSymbolInfo->count_;
             *c++ = *currentSymbolInfo++;
         }
-        split(decodeStream, decodedData, leftSize, leftSize >> 1, leftSymbolInfo);
-        split(decodeStream, decodedData + leftSize, rightSize, rightSize >> 1, rightSymbolInfo);
     }
 
 
+    //======================================================================================================================
+    // fully unrolled split for the small subtrees at the bottom of the tree.  the subtree size is a compile
+    // time constant so the recursion and the symbol lists all live on the stack.
+    static auto constexpr max_small_subtree_size = 32;
+
+    template <std::uint32_t size, typename decode_stream_type, typename symbol_type>
+    void split_small_subtree
+    (
+        decode_stream_type & decodeStream,
+        symbol_type * decodedData,
+        symbol_info const * parentSymbolInfo,
+        std::uint32_t depth
+    )
+    {
+        if (parentSymbolInfo[0].count_ >= size)
+        {
+            m99_run_fill(decodedData, size, (symbol_type)parentSymbolInfo[0].symbol_);
+            return;
+        }
+        if constexpr (size == 2)
+        {
+            auto c = pop_leaf_bit(decodeStream, depth);
+            decodedData[c == 1] = parentSymbolInfo[1].symbol_;
+            decodedData[c == 0] = parentSymbolInfo[0].symbol_; 
+        }
+        else if constexpr (size > 2)
+        {
+            static auto constexpr leftSize = (size >> 1);
+            static auto constexpr rightSize = (size - leftSize);
+            symbol_info leftSymbolInfo[leftSize + 1];
+            symbol_info rightSymbolInfo[rightSize + 1];
+            split_symbol_list(decodeStream, parentSymbolInfo, leftSize, rightSize, leftSymbolInfo, rightSymbolInfo, depth);
+            split_small_subtree<leftSize>(decodeStream, decodedData, leftSymbolInfo, depth + 1);
+            split_small_subtree<rightSize>(decodeStream, decodedData + leftSize, rightSymbolInfo, depth + 1);
+        }
+    }
+
+
+    template <typename decode_stream_type, typename symbol_type, std::size_t ... N>
+    constexpr auto make_split_small_subtree_table
+    (
+        std::index_sequence<N ...>
+    )
+    {
+        return std::array{&split_small_subtree<N + 1, decode_stream_type, symbol_type> ...};
+    }
+
+
+    // indexed by subtree size - 1
+    template <typename decode_stream_type, typename symbol_type>
+    auto constexpr split_small_subtree_table = make_split_small_subtree_table<decode_stream_type, symbol_type>(
+            std::make_index_sequence<max_small_subtree_size>());
+
+
+    //======================================================================================================================
+    // subtrees with only two distinct symbols are common deep in the tree (particularly for skewed data).  each node 
+    // of such a subtree codes a single value (how many of the first symbol go left.  the count of the second symbol 
+    // is then fully inferred and costs no bits) so the subtree can be decoded into a bitmap of the positions of the 
+    // first symbol without building any symbol lists, and the bitmap expanded to symbols in one pass.
+    static auto constexpr max_two_symbol_subtree_size = 64;
+
+    template <typename decode_stream_type>
+    std::uint64_t split_two_symbol_subtree
+    (
+        // returns a bitmap with bit 'i' set if position 'i' holds the first symbol
+        decode_stream_type & decodeStream,
+        std::uint32_t totalSize,
+        std::uint32_t leftSize,
+        std::uint32_t firstCount,
+        std::uint32_t depth
+    )
+    {
+        if (firstCount == 0)
+            return 0;
+        if (firstCount == totalSize)
+            return (~0ull >> (64 - totalSize));
+        if (totalSize == 2)
+            return (2ull >> pop_leaf_bit(decodeStream, depth)); // leaf bit is set when the first symbol comes first
+        std::uint32_t rightSize = (totalSize - leftSize);
+        auto leftCount = unpack_value(decodeStream, firstCount, leftSize, rightSize, depth);
+        auto leftBitmap = split_two_symbol_subtree(decodeStream, leftSize, leftSize >> 1, leftCount, depth + 1);
+        auto rightBitmap = split_two_symbol_subtree(decodeStream, rightSize, rightSize >> 1, firstCount - leftCount, depth + 1);
+        return (leftBitmap | (rightBitmap << leftSize));
+    }
+
+
+    //======================================================================================================================
+    template <typename symbol_type>
+    void expand_two_symbol_bitmap
+    (
+        symbol_type * decodedData,
+        std::uint32_t size,
+        std::uint64_t bitmap,
+        symbol_type first,
+        symbol_type second
+    )
+    {
+        if constexpr (sizeof(symbol_type) == 1)
+        {
+            #if defined(__AVX512BW__)
+                // blend and store all (up to 64) symbols at once
+                auto symbols = _mm512_mask_blend_epi8(bitmap, _mm512_set1_epi8(second), _mm512_set1_epi8(first));
+                _mm512_mask_storeu_epi8(decodedData, (~0ull >> (64 - size)), symbols);
+                return;
+            #elif defined(__BMI2__)
+                // deposit eight bits of the bitmap into the low bit of each of eight bytes and select with them
+                auto difference = ((first ^ second) * 0x0101010101010101ull);
+                auto seconds = (second * 0x0101010101010101ull);
+                for (std::uint32_t i = 0; i < size; i += 8, bitmap >>= 8)
+                {
+                    auto symbols = (seconds ^ (difference & (_pdep_u64(bitmap, 0x0101010101010101ull) * 0xff)));
+                    std::memcpy(decodedData + i, &symbols, std::min<std::uint32_t>(size - i, 8));
+                }
+                return;
+            #endif
+        }
+        for (std::uint32_t i = 0; i < size; ++i, bitmap >>= 1)
+            decodedData[i] = (bitmap & 1) ? first : second;
+    }
+
+
+    //======================================================================================================================
+    template <typename decode_stream_type, typename symbol_type>
+    void split
+    (
+        // non recursive depth first split.  the symbol list for the root is expected in arena.get(0, 0)
+        decode_stream_type & decodeStream,
+        symbol_type * decodedData,
+        std::uint32_t totalSize,
+        std::uint32_t leftSize,
+        symbol_list_arena & arena
+    )
+    {
+        struct frame
+        {
+            symbol_type *           decodedData_;
+            std::uint32_t           totalSize_;
+            std::uint32_t           leftSize_;
+            std::uint32_t           depth_;
+            symbol_info const *     symbolInfo_;
+        };
+        static auto constexpr leftSide = 0;
+        static auto constexpr rightSide = 1;
+
+        // each frame popped pushes at most two more so there are never more than max_depth + 1 pending
+        frame stack[symbol_list_arena::max_depth + 1];
+        std::uint32_t stackSize = 0;
+        stack[stackSize++] = {decodedData, totalSize, leftSize, 0, arena.get(0, leftSide)};
+        while (stackSize > 0)
+        {
+            auto [decodedData, totalSize, leftSize, depth, parentSymbolInfo] = stack[--stackSize];
+            if (parentSymbolInfo[0].count_ >= totalSize)
+            {
+                m99_run_fill(decodedData, totalSize, (symbol_type)parentSymbolInfo[0].symbol_);
+                continue;
+            }
+
+            if ((totalSize <= max_two_symbol_subtree_size) && 
+                    ((parentSymbolInfo[0].count_ + parentSymbolInfo[1].count_) == totalSize))
+            {
+                auto bitmap = split_two_symbol_subtree(decodeStream, totalSize, leftSize, parentSymbolInfo[0].count_, depth);
+                expand_two_symbol_bitmap(decodedData, totalSize, bitmap, (symbol_type)parentSymbolInfo[0].symbol_, 
+                        (symbol_type)parentSymbolInfo[1].symbol_);
+                continue;
+            }
+
+            if ((totalSize <= max_small_subtree_size) && (leftSize == (totalSize >> 1)))
+            {
+                split_small_subtree_table<decode_stream_type, symbol_type>[totalSize - 1](decodeStream, decodedData, parentSymbolInfo, depth);
+                continue;
+            }
+
+            std::uint32_t rightSize = (totalSize - leftSize);
+            auto leftSymbolInfo = arena.get(depth + 1, leftSide);
+            auto rightSymbolInfo = arena.get(depth + 1, rightSide);
+            split_symbol_list(decodeStream, parentSymbolInfo, leftSize, rightSize, leftSymbolInfo, rightSymbolInfo, depth);
+            // push right first so that the left subtree is decoded first
+            stack[stackSize++] = {decodedData + leftSize, rightSize, rightSize >> 1, depth + 1, rightSymbolInfo};
+            stack[stackSize++] = {decodedData, leftSize, leftSize >> 1, depth + 1, leftSymbolInfo};
+        }
+    }
+
+
+    //======================================================================================================================
+    template <typename symbol_type>
+    struct subtree_info
+    {
+        symbol_type *               decodedData_;
+        std::uint32_t               totalSize_;
+        std::uint32_t               leftSize_;
+        std::vector<symbol_info>    symbolInfo_;
+        std::size_t                 position_;
+        std::size_t                 length_;
+    };
+
+
+    //======================================================================================================================
+    template <typename symbol_type>
+    bool split_to_depth
+    (
+        // decode the top levels of the tree down to 'splitDepth'.  rather than decoding the subtrees below that
+        // depth (or any shallower leaf) their location in the stream is recorded in 'subtrees' and the stream is
+        // advanced past them using the subtree lengths which precede the tree.  returns false if the tree has
+        // more subtrees than there are lengths in [subtreeLength, subtreeLengthEnd).
+        m99_decode_stream & decodeStream,
+        symbol_type * decodedData,
+        std::uint32_t totalSize,
+        std::uint32_t leftSize,
+        std::uint32_t depth,
+        std::uint32_t splitDepth,
+        symbol_info const * parentSymbolInfo,
+        std::uint64_t const *& subtreeLength,
+        std::uint64_t const * subtreeLengthEnd,
+        std::vector<subtree_info<symbol_type>> & subtrees
+    )
+    {
+        auto symbolInfoEnd = parentSymbolInfo;
+        for (auto n = totalSize; n > 0; n -= (symbolInfoEnd++)->count_)
+            ;
+        if ((depth == splitDepth) || (parentSymbolInfo[0].count_ >= totalSize) || (totalSize <= 2))
+        {
+            if (subtreeLength == subtreeLengthEnd)
+                return false;
+            subtrees.push_back({decodedData, totalSize, leftSize, {parentSymbolInfo, symbolInfoEnd}, decodeStream.position(), 
+                    *subtreeLength++});
+            decodeStream.seek(decodeStream.position() + subtrees.back().length_);
+            return true;
+        }
+
+        // one extra entry because split speculatively writes one entry past the end of a full list
+        auto symbolCount = std::distance(parentSymbolInfo, symbolInfoEnd);
+        std::vector<symbol_info> leftSymbolInfo(symbolCount + 1);
+        std::vector<symbol_info> rightSymbolInfo(symbolCount + 1);
+        std::uint32_t rightSize = (totalSize - leftSize);
+        split_symbol_list(decodeStream, parentSymbolInfo, leftSize, rightSize, leftSymbolInfo.data(), rightSymbolInfo.data(), depth);
+        return (split_to_depth(decodeStream, decodedData, leftSize, leftSize >> 1, depth + 1, splitDepth, leftSymbolInfo.data(), 
+                subtreeLength, subtreeLengthEnd, subtrees) &&
+                split_to_depth(decodeStream, decodedData + leftSize, rightSize, rightSize >> 1, depth + 1, splitDepth, 
+                rightSymbolInfo.data(), subtreeLength, subtreeLengthEnd, subtrees));
+    }
+
+
+    //======================================================================================================================
+    template <typename symbol_type>
+    bool split_subtree
+    (
+        // decode one of the subtrees recorded by split_to_depth.  returns false if the subtree does not occupy
+        // exactly the length given for it.
+        m99_decode_stream const & decodeStream,
+        subtree_info<symbol_type> const & subtree,
+        m99_decode_context & context
+    )
+    {
+        auto subtreeStream = decodeStream.view();
+        subtreeStream.seek(subtree.position_);
+        std::uint64_t maxNodeSize = 1;
+        while (maxNodeSize < subtree.totalSize_)
+            maxNodeSize <<= 1;
+        auto workspace = context.acquire();
+        auto & arena = workspace->arena_;
+        arena.reset(maxNodeSize, subtree.symbolInfo_.size());
+        std::copy(subtree.symbolInfo_.begin(), subtree.symbolInfo_.end(), arena.get(0, 0));
+        split(subtreeStream, subtree.decodedData_, subtree.totalSize_, subtree.leftSize_, arena);
+        return (subtreeStream.position() == (subtree.position_ + subtree.length_));
+    }
+
+
+    //======================================================================================================================
+    template <typename symbol_type>
+    bool decode
+    (
+        // returns false if the stream is found to be corrupt.  the header and the subtree length table are checked
+        // as they are read.  the tree itself can not leave its bounds (each value is decoded within the limits
+        // which the counts above it allow) so a corrupt tree is found by the stream not being consumed exactly.
+        m99_decode_stream & decodeStream,
+        symbol_type * outputBegin,
+        symbol_type * outputEnd,
+        m99_decode_options const & options
+    )
+    {
+        // skip the zero padding and the 1 bit which follows it.  this is start of stream marker.  the padding is
+        // less than a byte so a window of zeros is not an m99 stream (and consuming past it would empty the window).
+        auto paddingSize = decodeStream.count_leading_zeros();
+        if (paddingSize == m99_decode_stream::max_peek_length)
+            return false;
+        decodeStream.consume(paddingSize + 1);
+
+        // decode the header stream.  the list is taken from the context and reused across calls.  every symbol
+        // listed occurs at least once and the symbols are listed in increasing order so a count of zero or a symbol
+        // which is out of order is corrupt (and would otherwise never end the loop or list more symbols than can occur).
+        auto & context = ((options.context_ != nullptr) ? *options.context_ : default_context());
+        auto workspace = context.acquire();
+        auto & symbolInfo = workspace->symbolInfo_;
+        symbolInfo.clear();
+        std::size_t symbolsToDecode = std::distance(outputBegin, outputEnd);
+        auto maxSymbolCount = std::min<std::uint64_t>(symbolsToDecode, alphabet_size<symbol_type>);
+        auto n = symbolsToDecode;
+        while (n > 0)
+        {
+            auto count = unpack_value(decodeStream, n, n, n);
+            std::uint32_t symbol = decodeStream.pop(sizeof(symbol_type) * 8);
+            if ((count == 0) || (symbolInfo.size() == maxSymbolCount) || 
+                    ((!symbolInfo.empty()) && (symbol <= symbolInfo.back().symbol_)))
+                return false;
+            symbolInfo.push_back({symbol, count});
+            n -= count;
+        }
+        std::uint32_t symbolCount = symbolInfo.size();
+        if constexpr (sizeof(symbol_type) <= 2)
+        {
+            if (options.symbolCounts_ != nullptr)
+            {
+                std::fill_n(options.symbolCounts_, alphabet_size<symbol_type>, 0);
+                for (auto [symbol, count] : symbolInfo)
+                    options.symbolCounts_[symbol] = count;
+            }
+        }
+
+        std::uint64_t leftSize = 1;
+        while (leftSize < symbolsToDecode)
+            leftSize <<= 1;
+
+        auto & arena = workspace->arena_;
+        if (options.adaptiveCoding_)
+        {
+            // high ratio mode.  a flag indicates whether the tree is range coded or flat coded.
+            arena.reset(leftSize, symbolCount);
+            std::copy(symbolInfo.begin(), symbolInfo.end(), arena.get(0, 0));
+            if (decodeStream.pop_bit())
+            {
+                adaptive_decode_source source(decodeStream);
+                split(source, outputBegin, symbolsToDecode, leftSize >> 1, arena);
+                if (source.corrupt_)
+                    return false;
+            }
+            else
+            {
+                split(decodeStream, outputBegin, symbolsToDecode, leftSize >> 1, arena);
+            }
+            return (decodeStream.position() == decodeStream.size());
+        }
+
+        if (options.splitDepth_ > 0)
+        {
+            // decode the subtree lengths and then the top of the tree.  the subtrees below the split depth
+            // are independent of each other and are decoded in parallel.  the encoder writes one length for each
+            // subtree at the split depth (or shallower leaf) so a count which could not have been written is corrupt.
+            std::uint64_t maxSubtreeCount = ((options.splitDepth_ < 32) ? (1ull << options.splitDepth_) : symbolsToDecode);
+            maxSubtreeCount = std::min<std::uint64_t>(maxSubtreeCount, symbolsToDecode);
+            std::uint64_t subtreeCount = decodeStream.pop(32);
+            if ((subtreeCount == 0) || (subtreeCount > maxSubtreeCount))
+                return false;
+            std::vector<std::uint64_t> subtreeLengths(subtreeCount);
+            std::uint32_t lengthSize = decodeStream.pop(6);
+            for (auto & subtreeLength : subtreeLengths)
+            {
+                if (lengthSize > 32)
+                    subtreeLength = (decodeStream.pop(lengthSize - 32) << 32);
+                subtreeLength |= decodeStream.pop((lengthSize > 32) ? 32 : lengthSize);
+            }
+            std::vector<subtree_info<symbol_type>> subtrees;
+            std::uint64_t const * subtreeLength = subtreeLengths.data();
+            std::uint64_t const * subtreeLengthEnd = (subtreeLength + subtreeLengths.size());
+            if ((!split_to_depth(decodeStream, outputBegin, symbolsToDecode, leftSize >> 1, 0, options.splitDepth_, 
+                    symbolInfo.data(), subtreeLength, subtreeLengthEnd, subtrees)) || (subtreeLength != subtreeLengthEnd))
+                return false;
+
+            std::atomic<bool> corrupt{false};
+            m99_thread_pool::instance().parallel_for(subtrees.size(), options.numThreads_, [&](std::size_t index)
+                    {
+                        if (!split_subtree(decodeStream, subtrees[index], context))
+                            corrupt = true;
+                    });
+            return ((!corrupt) && (decodeStream.position() == decodeStream.size()));
+        }
+
+        arena.reset(leftSize, symbolCount);
+        std::copy(symbolInfo.begin(), symbolInfo.end(), arena.get(0, 0));
+        split(decodeStream, outputBegin, symbolsToDecode, leftSize >> 1, arena);
+        return (decodeStream.position() == decodeStream.size());
+    }
+
 } // namespace
 
 
 //======================================================================================================================
-void maniscalco::m99_decode
+bool maniscalco::m99_decode
 (
     m99_decode_stream & decodeStream,
     std::uint8_t * outputBegin,
     std::uint8_t * outputEnd
 )
 {
-    while (!decodeStream.pop(1))
-        ; // pop until a 1 bit is decoded. this is start of stream marker.
-
-    // decode the header stream
-    symbol_info symbolInfo[256];
-    auto bytesToDecode = std::distance(outputBegin, outputEnd);
-    auto n = bytesToDecode;
-    for (auto i = 0; i < 256; ++i)
-    {
-        if (n == 0)
-            break;
-        symbolInfo[i].count_ = unpack_value(decodeStream, n, n, n);
-        symbolInfo[i].symbol_ = decodeStream.pop(8);
-        n -= symbolInfo[i].count_;
-    }
-    
-    std::uint32_t leftSize = 1;
-    while (leftSize < bytesToDecode)
-        leftSize <<= 1;
-    split(decodeStream, outputBegin, bytesToDecode, leftSize >> 1, symbolInfo);
+    return decode(decodeStream, outputBegin, outputEnd, {});
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_decode
+(
+    m99_decode_stream & decodeStream,
+    std::uint8_t * outputBegin,
+    std::uint8_t * outputEnd,
+    m99_decode_options const & options
+)
+{
+    return decode(decodeStream, outputBegin, outputEnd, options);
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_decode
+(
+    m99_decode_stream & decodeStream,
+    std::uint16_t * outputBegin,
+    std::uint16_t * outputEnd
+)
+{
+    return decode(decodeStream, outputBegin, outputEnd, {});
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_decode
+(
+    m99_decode_stream & decodeStream,
+    std::uint16_t * outputBegin,
+    std::uint16_t * outputEnd,
+    m99_decode_options const & options
+)
+{
+    return decode(decodeStream, outputBegin, outputEnd, options);
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_decode
+(
+    m99_decode_stream & decodeStream,
+    std::uint32_t * outputBegin,
+    std::uint32_t * outputEnd
+)
+{
+    return decode(decodeStream, outputBegin, outputEnd, {});
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_decode
+(
+    m99_decode_stream & decodeStream,
+    std::uint32_t * outputBegin,
+    std::uint32_t * outputEnd,
+    m99_decode_options const & options
+)
+{
+    return decode(decodeStream, outputBegin, outputEnd, options);
+}
+
+
+//======================================================================================================================
+void maniscalco::m99_decode_context::workspace_releaser::operator ()
+(
+    workspace_type * workspace
+) const
+{
+    std::lock_guard lockGuard(context_->mutex_);
+    context_->available_.emplace_back(workspace);
+}
+
+
+//======================================================================================================================
+maniscalco::m99_decode_context::m99_decode_context
+(
+)
+{
 }
 
+
+//======================================================================================================================
+maniscalco::m99_decode_context::~m99_decode_context
+(
+)
+{
+}
+
+
+//======================================================================================================================
+auto maniscalco::m99_decode_context::acquire
+(
+    // takes a workspace which is not in use (or creates one if there are none)
+) -> workspace_handle
+{
+    std::unique_lock uniqueLock(mutex_);
+    if (available_.empty())
+    {
+        uniqueLock.unlock();
+        return workspace_handle(new workspace_type, {this});
+    }
+    auto workspace = available_.back().release();
+    available_.pop_back();
+    return workspace_handle(workspace, {this});
+}
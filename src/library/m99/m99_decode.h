@@ -3,17 +3,125 @@
 #include "./m99_decode_stream.h"
 
 #include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 
 namespace maniscalco
 {
 
-    void m99_decode
+    // working state of the decoder: the header's symbol list and the symbol lists of the split.  each decode (and
+    // each subtree decoded on a thread of its own) takes a workspace from the context and returns it when done so a
+    // context which decodes a stream of blocks reaches a steady state in which nothing is allocated.  decodes may
+    // share a context concurrently.
+    class m99_decode_context
+    {
+    public:
+
+        struct workspace_type;
+
+        struct workspace_releaser
+        {
+            void operator ()
+            (
+                workspace_type *
+            ) const;
+
+            m99_decode_context * context_;
+        };
+
+        // a workspace for the sole use of its holder.  destroying the handle returns the workspace to the context.
+        using workspace_handle = std::unique_ptr<workspace_type, workspace_releaser>;
+
+        m99_decode_context();
+
+        m99_decode_context(m99_decode_context const &) = delete;
+
+        m99_decode_context & operator = (m99_decode_context const &) = delete;
+
+        ~m99_decode_context();
+
+        workspace_handle acquire();
+
+    private:
+
+        std::mutex mutex_;
+
+        std::vector<std::unique_ptr<workspace_type>> available_;
+
+    };
+
+
+    struct m99_decode_options
+    {
+        // number of threads used to decode the independent subtrees of the stream.
+        // only used when the stream was encoded with a non zero split depth.
+        std::size_t numThreads_{1};
+
+        // must match the split depth that the stream was encoded with
+        std::uint32_t splitDepth_{0};
+
+        // must match the mode that the stream was encoded with.  splitDepth_ is ignored when this is set.
+        bool adaptiveCoding_{false};
+
+        // when not null receives the number of occurrences of each symbol in the decoded data (indexed by symbol).
+        // these are known from the header so this costs nothing.  byte and 16 bit symbols only.
+        std::uint32_t * symbolCounts_{nullptr};
+
+        // the working state to decode with.  when null a context shared by the whole process is used.
+        m99_decode_context * context_{nullptr};
+    };
+
+    // decodes a stream produced by m99_encode into [begin, end).  returns false if the stream is found to be corrupt:
+    // a bad start marker, header or subtree length table, a decoded value out of range or a stream which is not
+    // consumed exactly.  not every corruption is detectable this way.  use the frame checksums for that.
+    bool m99_decode
     (
         m99_decode_stream &,
         std::uint8_t *,
         std::uint8_t *
     );
 
+    bool m99_decode
+    (
+        m99_decode_stream &,
+        std::uint8_t *,
+        std::uint8_t *,
+        m99_decode_options const &
+    );
+
+    // wide symbol variants.  the stream must have been encoded from symbols of the same width.
+    bool m99_decode
+    (
+        m99_decode_stream &,
+        std::uint16_t *,
+        std::uint16_t *
+    );
+
+    bool m99_decode
+    (
+        m99_decode_stream &,
+        std::uint16_t *,
+        std::uint16_t *,
+        m99_decode_options const &
+    );
+
+    bool m99_decode
+    (
+        m99_decode_stream &,
+        std::uint32_t *,
+        std::uint32_t *
+    );
+
+    bool m99_decode
+    (
+        m99_decode_stream &,
+        std::uint32_t *,
+        std::uint32_t *,
+        m99_decode_options const &
+    );
+
 } // namespace maniscalco
 
@@ -2,8 +2,8 @@
 
 #include <library/io.h>
 
-#include <vector>
 #include <cstdint>
+#include <cstring>
 
 
 namespace maniscalco
@@ -13,41 +13,239 @@ namespace maniscalco
     {
     public:
 
-        static auto constexpr stream_direction = io::stream_direction::forward;
-        using stream_type = io::push_stream<stream_direction>;
-        using packet_type = stream_type::packet_type;
+        static auto constexpr max_peek_length = 56;
 
         m99_decode_stream
         (
-            buffer b,
-            buffer::size_type size
-        ):
-            stream_
-            (
-                {.inputHandler_ = [this](){return std::move(packet_);}}
-            ),
-            packet_(std::move(b), 0, size * 8)
-        {
-        }
-
-        auto pop
+            buffer,
+            buffer::size_type
+        );
+
+        m99_decode_stream
+        (
+            std::uint8_t const *,
+            std::uint8_t const *
+        );
+
+        m99_decode_stream(m99_decode_stream &&) = default;
+
+        m99_decode_stream & operator = (m99_decode_stream &&) = default;
+
+        std::uint64_t peek
+        (
+            std::size_t
+        );
+
+        void consume
+        (
+            std::size_t
+        );
+
+        std::uint64_t pop
+        (
+            std::size_t
+        );
+
+        std::uint64_t pop_bit();
+
+        std::size_t count_leading_zeros();
+
+        std::size_t position() const;
+
+        std::size_t size() const;
+
+        void seek
         (
-            std::size_t codeLength
-        )
-        {
-            return stream_.pop(codeLength);
-        }
-
-        auto pop_bit()
-        {
-            return stream_.pop_bit();
-        }
-        
+            std::size_t
+        );
+
+        m99_decode_stream view() const;
+
     private:
 
-        io::forward_pop_stream stream_;
+        void refill();
+
+        void refill_tail();
+
+        buffer buffer_;
+
+        std::uint8_t const * data_;
+
+        // index of the next byte to load.  this can run past size_ at the end of the stream
+        // where the stream is read as though it were padded with zeros.
+        std::size_t current_;
+
+        std::size_t size_;
+
+        // bits are held msb aligned.  the next bit in the stream is bit 63 of window_.
+        // bits below the first windowSize_ bits are either zero or are copies of the bits
+        // which follow in the stream so refill can simply 'or' the next eight bytes in.
+        std::uint64_t window_{0};
 
-        packet_type packet_;
+        std::size_t windowSize_{0};
 
     };
-} // namespace maniscalco
\ No newline at end of file
+} // namespace maniscalco
+
+
+//=============================================================================
+inline maniscalco::m99_decode_stream::m99_decode_stream
+(
+    buffer b,
+    buffer::size_type size
+):
+    buffer_(std::move(b)),
+    data_(buffer_.data()),
+    current_(0),
+    size_(size)
+{
+}
+
+
+//=============================================================================
+inline maniscalco::m99_decode_stream::m99_decode_stream
+(
+    // non owning stream over [begin, end)
+    std::uint8_t const * begin,
+    std::uint8_t const * end
+):
+    data_(begin),
+    current_(0),
+    size_(std::distance(begin, end))
+{
+}
+
+
+//=============================================================================
+inline void maniscalco::m99_decode_stream::refill
+(
+)
+{
+    // branchless refill.  load the next eight bytes (unaligned, big endian) and advance by however
+    // many whole bytes fit into the window.  afterwards the window holds at least 56 valid bits.
+    if ((current_ + 8) <= size_)
+    {
+        std::uint64_t bits;
+        std::memcpy(&bits, data_ + current_, sizeof(bits));
+        window_ |= (__builtin_bswap64(bits) >> windowSize_);
+        current_ += ((63 - windowSize_) >> 3);
+        windowSize_ |= 56;
+        return;
+    }
+    refill_tail();
+}
+
+
+//=============================================================================
+inline void maniscalco::m99_decode_stream::refill_tail
+(
+)
+{
+    // fewer than eight bytes remain.  assemble them byte by byte and pad with zeros.
+    std::uint64_t bits = 0;
+    for (auto i = current_; i < size_; ++i)
+        bits |= ((std::uint64_t)data_[i] << (56 - ((i - current_) * 8)));
+    window_ |= (bits >> windowSize_);
+    current_ += ((63 - windowSize_) >> 3);
+    windowSize_ |= 56;
+}
+
+
+//=============================================================================
+inline std::uint64_t maniscalco::m99_decode_stream::peek
+(
+    // returns the next codeLength bits (codeLength <= max_peek_length) without consuming them
+    std::size_t codeLength
+)
+{
+    if (windowSize_ < codeLength)
+        refill();
+    return ((window_ >> 1) >> (63 - codeLength));
+}
+
+
+//=============================================================================
+inline void maniscalco::m99_decode_stream::consume
+(
+    std::size_t codeLength
+)
+{
+    window_ <<= codeLength;
+    windowSize_ -= codeLength;
+}
+
+
+//=============================================================================
+inline std::uint64_t maniscalco::m99_decode_stream::pop
+(
+    std::size_t codeLength
+)
+{
+    auto code = peek(codeLength);
+    consume(codeLength);
+    return code;
+}
+
+
+//=============================================================================
+inline std::uint64_t maniscalco::m99_decode_stream::pop_bit
+(
+)
+{
+    return pop(1);
+}
+
+
+//=============================================================================
+inline std::size_t maniscalco::m99_decode_stream::count_leading_zeros
+(
+)
+{
+    // number of zero bits before the next set bit (up to max_peek_length)
+    auto bits = peek(max_peek_length);
+    return (bits == 0) ? max_peek_length : (__builtin_clzll(bits) - (64 - max_peek_length));
+}
+
+
+//=============================================================================
+inline std::size_t maniscalco::m99_decode_stream::position
+(
+) const
+{
+    // number of bits consumed since the start of the stream
+    return ((current_ * 8) - windowSize_);
+}
+
+
+//=============================================================================
+inline std::size_t maniscalco::m99_decode_stream::size
+(
+) const
+{
+    // number of bits in the stream.  a stream is consumed exactly (position() == size()) once it is decoded.
+    return (size_ * 8);
+}
+
+
+//=============================================================================
+inline void maniscalco::m99_decode_stream::seek
+(
+    std::size_t bitPosition
+)
+{
+    current_ = (bitPosition / 8);
+    window_ = 0;
+    windowSize_ = 0;
+    refill();
+    consume(bitPosition % 8);
+}
+
+
+//=============================================================================
+inline auto maniscalco::m99_decode_stream::view
+(
+) const -> m99_decode_stream
+{
+    // non owning stream over the same bytes, positioned at the start
+    return m99_decode_stream(data_, data_ + size_);
+}
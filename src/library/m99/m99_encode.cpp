@@ -1,4 +1,15 @@
 #include "./m99_encode.h"
+#include "./m99_adaptive_coder.h"
+#include "./m99_run_length.h"
+#include "./m99_thread_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 
 namespace
@@ -6,14 +17,19 @@ namespace
 
     using namespace maniscalco;
 
+    // symbols of every supported width are held as 32 bits.  this costs nothing for 8 bit symbols
+    // since the structure is padded to eight bytes either way.
     struct symbol_info
     {
         symbol_info(){}
-        symbol_info(std::uint8_t symbol, std::uint32_t count):symbol_(symbol), count_(count){}
-        std::uint8_t    symbol_;
+        symbol_info(std::uint32_t symbol, std::uint32_t count):symbol_(symbol), count_(count){}
+        std::uint32_t   symbol_;
         std::uint32_t   count_;
     };
 
+    template <typename symbol_type>
+    static auto constexpr alphabet_size = (1ull << (sizeof(symbol_type) * 8));
+
     struct tiny_encode_table_entry_type
     {
         std::uint32_t value_;
@@ -121,56 +137,322 @@ namespace
     }
 
 
-    //==========================================================================
-    void merge
+    //======================================================================================================================
+    void pack_value
     (
         m99_encode_stream & encodeStream,
-        std::uint8_t const * begin,
-        std::uint32_t totalSize,
-        std::uint32_t leftSize,
-        symbol_info * result,
-        std::uint32_t leadingRunLength
+        std::uint32_t left,
+        std::uint32_t total,
+        std::uint32_t maxLeft,
+        std::uint32_t maxRight,
+        std::uint32_t
+    )
+    {
+        pack_value(encodeStream, left, total, maxLeft, maxRight);
+    }
+
+
+    //======================================================================================================================
+    void push_leaf_bit
+    (
+        m99_encode_stream & encodeStream,
+        std::uint32_t bit,
+        std::uint32_t length,
+        std::uint32_t
+    )
+    {
+        encodeStream.push(bit, length);
+    }
+
+
+    //======================================================================================================================
+    // stands in for the encode stream when only the size of the encoding is wanted.  only the lengths 
+    // of the codes are accumulated and no bits are written.
+    class bit_counter
+    {
+    public:
+
+        void push
+        (
+            std::uint64_t,
+            std::size_t length
+        )
+        {
+            size_ += length;
+        }
+
+        std::size_t size() const
+        {
+            return size_;
+        }
+
+    private:
+
+        std::size_t size_{0};
+    };
+
+
+    //======================================================================================================================
+    void pack_value
+    (
+        // as the flat coded pack_value but only the length of the code is computed
+        bit_counter & bitCounter,
+        std::uint32_t left,
+        std::uint32_t total,
+        std::uint32_t maxLeft,
+        std::uint32_t maxRight,
+        std::uint32_t
     )
     {
-        if (leadingRunLength >= totalSize)
+        if (total < 8)
         {
-            result[0] = {begin[0], totalSize};
+            bitCounter.push(0, tinyEncodeTable[(maxLeft >= 8) ? 7 : maxLeft][(maxRight >= 8) ? 7 : maxRight][left][total].length_);
             return;
         }
-        if (totalSize <= 2)
+        if (total > maxLeft)
+        {
+            auto inferredRight = (total - maxLeft);
+            maxRight -= inferredRight;
+            total -= inferredRight;
+        }
+        if (total > maxRight)
+        {
+            auto inferredLeft = (total - maxRight);
+            left -= inferredLeft;
+            total -= inferredLeft;
+        }
+        if (total)
+        {
+            std::uint32_t codeLength = 1;
+            while (total >> ++codeLength)
+                ;
+            --codeLength;
+            auto needMsb = ((left | (1ull << codeLength)) <= total);
+            bitCounter.push(0, codeLength + needMsb);
+        }
+    }
+
+
+    //======================================================================================================================
+    void push_leaf_bit
+    (
+        bit_counter & bitCounter,
+        std::uint32_t bit,
+        std::uint32_t length,
+        std::uint32_t
+    )
+    {
+        bitCounter.push(bit, length);
+    }
+
+
+    //======================================================================================================================
+    // high ratio mode.  the merge produces its values in the reverse of decode order so rather than coding them
+    // as they are produced the decisions are recorded and then range coded in decode order once the merge is done.
+    class adaptive_decision_recorder
+    {
+    public:
+
+        struct decision
+        {
+            std::uint32_t value_;
+            std::uint32_t total_;       // zero for a leaf bit
+            std::uint32_t expected_;
+            std::uint32_t depth_;
+        };
+
+        void record
+        (
+            decision const & d
+        )
+        {
+            decisions_.push_back(d);
+        }
+
+        void clear
+        (
+        )
+        {
+            decisions_.clear();
+        }
+
+        std::vector<std::uint8_t> const & encode
+        (
+        )
         {
-            if (totalSize == 2)
+            m99_adaptive_model model;
+            encoder_ = {};
+            for (auto iter = decisions_.rbegin(); iter != decisions_.rend(); ++iter)
             {
-                auto c = (unsigned)(begin[0] < begin[1]);
-                result[0] = {begin[!c], 1 + (unsigned)(begin[0] == begin[1])};
-                result[1] = {begin[c], 1};
-                encodeStream.push(c, begin[0] != begin[1]);
+                if (iter->total_ == 0)
+                    encoder_.encode_bit(model.leaf_bit(iter->depth_), iter->value_);
+                else
+                    encoder_.encode_value(model, iter->value_, iter->total_, iter->expected_, iter->depth_);
             }
-            else
+            encoder_.flush();
+            return encoder_.data();
+        }
+
+    private:
+
+        std::vector<decision> decisions_;
+
+        m99_range_encoder encoder_;
+
+    };
+
+
+    //======================================================================================================================
+    void pack_value
+    (
+        adaptive_decision_recorder & recorder,
+        std::uint32_t left,
+        std::uint32_t total,
+        std::uint32_t maxLeft,
+        std::uint32_t maxRight,
+        std::uint32_t depth
+    )
+    {
+        if (total > maxLeft)
+        {
+            auto inferredRight = (total - maxLeft);
+            maxRight -= inferredRight;
+            total -= inferredRight;
+        }
+        if (total > maxRight)
+        {
+            auto inferredLeft = (total - maxRight);
+            left -= inferredLeft;
+            total -= inferredLeft;
+        }
+        if (total)
+            recorder.record({left, total, m99_adaptive_model::expected_value(total, maxLeft, maxRight), depth});
+    }
+
+
+    //======================================================================================================================
+    void push_leaf_bit
+    (
+        adaptive_decision_recorder & recorder,
+        std::uint32_t bit,
+        std::uint32_t length,
+        std::uint32_t depth
+    )
+    {
+        if (length)
+            recorder.record({bit, 0, 0, depth});
+    }
+
+
+    using encode_value_type = std::tuple<std::uint32_t, std::uint32_t, std::uint32_t, std::uint32_t>;
+
+
+    //==========================================================================
+    // compact symbol lists for the merge.  because the merge is depth first only one node per depth
+    // is ever in progress, so each depth needs just two lists (the results of its left and right
+    // children).  the lists at depth 'd' have room for min(alphabet size, maxNodeSize >> d) entries
+    // which keeps the lists near the leaves tiny and hot in cache.  for wide symbols the lists are
+    // sparse (only the symbols present are listed) so the space is bounded by the node sizes.
+    class symbol_list_arena
+    {
+    public:
+
+        static auto constexpr max_depth = 34;
+
+        void reset
+        (
+            std::uint64_t maxNodeSize,
+            std::uint64_t alphabetSize
+        )
+        {
+            std::size_t size = 0;
+            for (auto depth = 0; depth < max_depth; ++depth)
             {
-                result[0] = {begin[0], 1};
+                auto nodeSize = (maxNodeSize >> depth);
+                auto capacity = ((nodeSize < alphabetSize) ? nodeSize : alphabetSize) + 1;
+                offset_[depth][0] = size;
+                offset_[depth][1] = size + capacity;
+                size += (capacity * 2);
             }
-            return;
+            if (symbolInfo_.size() < size)
+                symbolInfo_.resize(size);
+            if (valuesToEncode_.size() < offset_[0][1])
+                valuesToEncode_.resize(offset_[0][1]);
+        }
+
+        symbol_info * get
+        (
+            std::uint32_t depth,
+            std::uint32_t side
+        )
+        {
+            return (symbolInfo_.data() + offset_[depth][side]);
+        }
+
+        encode_value_type * values
+        (
+        )
+        {
+            return valuesToEncode_.data();
         }
 
-        std::uint32_t rightSize = (totalSize - leftSize);
-        symbol_info left[256];
-        symbol_info right[256];
+    private:
+
+        std::vector<symbol_info> symbolInfo_;
+
+        std::size_t offset_[max_depth][2];
+
+        std::vector<encode_value_type> valuesToEncode_;
+
+    };
+
+} // namespace
+
+
+//==========================================================================
+struct maniscalco::m99_encode_context::workspace_type
+{
+    symbol_list_arena               arena_;
+    adaptive_decision_recorder      recorder_;
+    std::vector<symbol_info>        symbolList_;        // the root symbol list
+    std::vector<std::uint64_t>      subtreeLengths_;
+};
+
+
+namespace
+{
+
+    //==========================================================================
+    m99_encode_context & default_context
+    (
+        // the context used by encodes which are not given one
+    )
+    {
+        static m99_encode_context context;
+        return context;
+    }
+
+
+    //==========================================================================
+    template <typename encode_stream_type>
+    void merge_symbol_lists
+    (
+        // merge the symbol lists of the left and right children into the list for the parent
+        // and encode how each symbol's count is distributed between the two children.
+        encode_stream_type & encodeStream,
+        symbol_info const * left,
+        symbol_info const * right,
+        std::uint32_t leftSize,
+        std::uint32_t rightSize,
+        symbol_info * result,
+        encode_value_type * valuesToEncode,
+        std::uint32_t depth
+    )
+    {
         symbol_info const * current[2] = {left, right};
         symbol_info * resultCurrent = result;
         static auto constexpr leftSide = 0;
         static auto constexpr rightSide = 1;
-        auto rightLeadingRunLength = (leadingRunLength > leftSize) ? (leadingRunLength - leftSize) : [](std::uint8_t const * begin, std::uint8_t const * end)
-        {
-            auto cur = begin;
-            auto s = *cur;
-            while ((cur < end) && (*cur == s))
-                ++cur;
-            return std::distance(begin, cur);
-        }(begin + leftSize, begin + totalSize);
-
-        merge(encodeStream, begin + leftSize, rightSize, rightSize >> 1, right, rightLeadingRunLength);
-        merge(encodeStream, begin, leftSize, leftSize >> 1, left, leadingRunLength);
 
         #pragma pack(push, 1)
         using size_union = union size_union
@@ -185,7 +467,6 @@ namespace
         };
         #pragma pack(pop)
 
-        std::array<std::tuple<std::uint32_t, std::uint32_t, std::uint32_t, std::uint32_t>, 256> valuesToEncode;
         std::uint32_t numValuesToEncode{0};
 
         size_union partitionSize_(leftSize, rightSize);
@@ -196,7 +477,10 @@ namespace
                 (-(current[rightSide]->symbol_ <= current[leftSide]->symbol_) & (std::uint32_t)current[rightSide]->count_)
             );
             auto totalCount = (count.size_.left_ + count.size_.right_);
-            valuesToEncode[numValuesToEncode++] = {count.size_.left_, totalCount, partitionSize_.size_.left_, partitionSize_.size_.right_};
+            if constexpr (std::is_same_v<encode_stream_type, bit_counter>)
+                pack_value(encodeStream, count.size_.left_, totalCount, partitionSize_.size_.left_, partitionSize_.size_.right_, depth);
+            else
+                valuesToEncode[numValuesToEncode++] = {count.size_.left_, totalCount, partitionSize_.size_.left_, partitionSize_.size_.right_};
             partitionSize_.union_ -= count.union_;
             *resultCurrent++ = {current[(count.size_.left_ == 0)]->symbol_, totalCount};
             current[leftSide] += (count.size_.left_ != 0);
@@ -210,12 +494,460 @@ namespace
             *resultCurrent++ = *c++;
         }
 
-
+        // the values are pushed in reverse (other than when only counting the bits which can be done in any order)
         while (numValuesToEncode)
         {
             auto [left, total, maxLeft, maxRight] = valuesToEncode[--numValuesToEncode];
-            pack_value(encodeStream, left, total, maxLeft, maxRight);
+            pack_value(encodeStream, left, total, maxLeft, maxRight, depth);
+        }
+    }
+
+
+    //==========================================================================
+    // fully unrolled merge for the small subtrees at the bottom of the tree.  the subtree size is a compile
+    // time constant so the recursion, the symbol lists and the values to encode all live on the stack.
+    static auto constexpr max_small_subtree_size = 32;
+
+    template <std::uint32_t size, typename encode_stream_type, typename symbol_type>
+    void merge_small_subtree
+    (
+        encode_stream_type & encodeStream,
+        symbol_type const * begin,
+        std::uint32_t leadingRunLength,
+        symbol_info * result,
+        std::uint32_t depth
+    )
+    {
+        if ((size == 1) || (leadingRunLength >= size))
+        {
+            result[0] = {begin[0], size};
+        }
+        else if constexpr (size == 2)
+        {
+            auto c = (unsigned)(begin[0] < begin[1]);
+            result[0] = {begin[!c], 1 + (unsigned)(begin[0] == begin[1])};
+            result[1] = {begin[c], 1};
+            push_leaf_bit(encodeStream, c, begin[0] != begin[1], depth);
+        }
+        else if constexpr (size > 2)
+        {
+            static auto constexpr leftSize = (size >> 1);
+            static auto constexpr rightSize = (size - leftSize);
+            symbol_info left[leftSize + 1];
+            symbol_info right[rightSize + 1];
+            encode_value_type valuesToEncode[size];
+            auto rightLeadingRunLength = (leadingRunLength > leftSize) ? (leadingRunLength - leftSize) : 
+                    m99_run_length(begin + leftSize, begin + size);
+            merge_small_subtree<rightSize>(encodeStream, begin + leftSize, rightLeadingRunLength, right, depth + 1);
+            merge_small_subtree<leftSize>(encodeStream, begin, leadingRunLength, left, depth + 1);
+            merge_symbol_lists(encodeStream, left, right, leftSize, rightSize, result, valuesToEncode, depth);
+        }
+    }
+
+
+    template <typename encode_stream_type, typename symbol_type, std::size_t ... N>
+    constexpr auto make_merge_small_subtree_table
+    (
+        std::index_sequence<N ...>
+    )
+    {
+        return std::array{&merge_small_subtree<N + 1, encode_stream_type, symbol_type> ...};
+    }
+
+
+    // indexed by subtree size - 1
+    template <typename encode_stream_type, typename symbol_type>
+    auto constexpr merge_small_subtree_table = make_merge_small_subtree_table<encode_stream_type, symbol_type>(
+            std::make_index_sequence<max_small_subtree_size>());
+
+
+    //==========================================================================
+    template <typename encode_stream_type, typename symbol_type>
+    void merge
+    (
+        // non recursive depth first merge.  the right subtree is encoded first, then the left subtree,
+        // and then the merge of the two.  the resulting symbol list is left in arena.get(0, 0).
+        // 'baseDepth' is the depth of this subtree within the whole tree.
+        encode_stream_type & encodeStream,
+        symbol_type const * begin,
+        std::uint32_t totalSize,
+        std::uint32_t leftSize,
+        std::uint32_t leadingRunLength,
+        std::uint32_t baseDepth,
+        symbol_list_arena & arena
+    )
+    {
+        struct frame
+        {
+            symbol_type const *     begin_;
+            std::uint32_t           totalSize_;
+            std::uint32_t           leftSize_;
+            std::uint32_t           leadingRunLength_;
+            std::uint32_t           side_;
+            std::uint32_t           state_;
+        };
+        static auto constexpr visit = 0;
+        static auto constexpr visit_left = 1;
+        static auto constexpr merge_children = 2;
+        static auto constexpr leftSide = 0;
+        static auto constexpr rightSide = 1;
+
+        frame stack[symbol_list_arena::max_depth];
+        std::int32_t depth = 0;
+        stack[depth] = {begin, totalSize, leftSize, leadingRunLength, leftSide, visit};
+        while (depth >= 0)
+        {
+            auto & current = stack[depth];
+            switch (current.state_)
+            {
+                case visit:
+                {
+                    auto result = arena.get(depth, current.side_);
+                    auto begin = current.begin_;
+                    if (current.leadingRunLength_ >= current.totalSize_)
+                    {
+                        result[0] = {begin[0], current.totalSize_};
+                        --depth;
+                        break;
+                    }
+                    if ((current.totalSize_ <= max_small_subtree_size) && (current.leftSize_ == (current.totalSize_ >> 1)))
+                    {
+                        merge_small_subtree_table<encode_stream_type, symbol_type>[current.totalSize_ - 1](encodeStream, begin, 
+                                current.leadingRunLength_, result, baseDepth + depth);
+                        --depth;
+                        break;
+                    }
+                    auto leftSize = current.leftSize_;
+                    auto rightSize = (current.totalSize_ - leftSize);
+                    auto rightLeadingRunLength = (current.leadingRunLength_ > leftSize) ? (current.leadingRunLength_ - leftSize) : 
+                            m99_run_length(begin + leftSize, begin + current.totalSize_);
+                    current.state_ = visit_left;
+                    stack[++depth] = {begin + leftSize, rightSize, rightSize >> 1, (std::uint32_t)rightLeadingRunLength, rightSide, visit};
+                    break;
+                }
+
+                case visit_left:
+                {
+                    auto leftSize = current.leftSize_;
+                    current.state_ = merge_children;
+                    stack[depth + 1] = {current.begin_, leftSize, leftSize >> 1, current.leadingRunLength_, leftSide, visit};
+                    ++depth;
+                    break;
+                }
+
+                case merge_children:
+                {
+                    merge_symbol_lists(encodeStream, arena.get(depth + 1, leftSide), arena.get(depth + 1, rightSide), 
+                            current.leftSize_, current.totalSize_ - current.leftSize_, arena.get(depth, current.side_), arena.values(), 
+                            baseDepth + depth);
+                    --depth;
+                    break;
+                }
+            }
+        }
+    }
+
+    //==========================================================================
+    std::uint32_t copy_symbol_list
+    (
+        // copy a symbol list which covers 'size' symbols and return the number of entries copied
+        symbol_info const * source,
+        std::uint32_t size,
+        symbol_info * destination
+    )
+    {
+        std::uint32_t count = 0;
+        while (size > 0)
+        {
+            size -= source->count_;
+            destination[count++] = *source++;
+        }
+        return count;
+    }
+
+
+    //==========================================================================
+    struct fork_merge_configuration
+    {
+        std::uint32_t forkDepth_;
+        std::uint32_t splitDepth_;
+    };
+
+
+    //==========================================================================
+    template <typename symbol_type>
+    void fork_merge
+    (
+        // merge of the top levels of the tree.  for the top 'forkDepth' levels the left subtree of each node
+        // is encoded on a separate thread into its own stream while the right subtree is encoded into
+        // 'encodeStream'.  the left stream is then concatenated at bit level so the output is identical
+        // to that of the serial merge.
+        // if 'splitDepth' is non zero then the encoded length (in bits) of each subtree at that depth (or of
+        // any shallower subtree which is a leaf) is appended to 'subtreeLengths' in left to right order.
+        m99_encode_stream & encodeStream,
+        symbol_type const * begin,
+        std::uint32_t totalSize,
+        std::uint32_t leftSize,
+        std::uint32_t leadingRunLength,
+        std::uint32_t depth,
+        fork_merge_configuration const & configuration,
+        symbol_info * result,
+        std::vector<std::uint64_t> & subtreeLengths,
+        m99_encode_context & context
+    )
+    {
+        static auto constexpr min_fork_size = (1 << 16);
+
+        auto [forkDepth, splitDepth] = configuration;
+        auto startSize = encodeStream.size();
+        auto isLeaf = ((leadingRunLength >= totalSize) || (totalSize <= 2));
+        auto isSubtree = ((splitDepth > 0) && ((depth == splitDepth) || ((depth < splitDepth) && isLeaf)));
+        auto fork = ((depth < forkDepth) && (totalSize >= min_fork_size));
+
+        if (isLeaf || (!fork && (depth >= splitDepth)))
+        {
+            std::uint64_t maxNodeSize = 1;
+            while (maxNodeSize < totalSize)
+                maxNodeSize <<= 1;
+            auto workspace = context.acquire();
+            auto & arena = workspace->arena_;
+            arena.reset(maxNodeSize, alphabet_size<symbol_type>);
+            merge(encodeStream, begin, totalSize, leftSize, leadingRunLength, depth, arena);
+            copy_symbol_list(arena.get(0, 0), totalSize, result);
+        }
+        else
+        {
+            auto rightSize = (totalSize - leftSize);
+            auto rightLeadingRunLength = (leadingRunLength > leftSize) ? (leadingRunLength - leftSize) : 
+                    m99_run_length(begin + leftSize, begin + totalSize);
+
+            std::vector<symbol_info> left(std::min<std::uint64_t>(leftSize, alphabet_size<symbol_type>) + 1);
+            std::vector<symbol_info> right(std::min<std::uint64_t>(rightSize, alphabet_size<symbol_type>) + 1);
+            std::vector<std::uint64_t> leftSubtreeLengths;
+            std::vector<std::uint64_t> rightSubtreeLengths;
+            if (fork)
+            {
+                auto leftBuffer = context.buffer_pool().acquire(m99_encode_bound<symbol_type>(leftSize));
+                m99_encode_stream leftStream(leftBuffer.data(), leftBuffer.data() + leftBuffer.size());
+                // the right subtree is encoded first (it precedes the left in the stream) and the left is encoded
+                // into a stream of its own which is appended to it
+                m99_thread_pool::instance().parallel_for(2, 2, [&](std::size_t index)
+                        {
+                            if (index == 0)
+                                fork_merge(encodeStream, begin + leftSize, rightSize, rightSize >> 1, rightLeadingRunLength, depth + 1, 
+                                        configuration, right.data(), rightSubtreeLengths, context);
+                            else
+                                fork_merge(leftStream, begin, leftSize, leftSize >> 1, leadingRunLength, depth + 1, configuration, 
+                                        left.data(), leftSubtreeLengths, context);
+                        });
+                encodeStream.append(leftStream);
+            }
+            else
+            {
+                fork_merge(encodeStream, begin + leftSize, rightSize, rightSize >> 1, rightLeadingRunLength, depth + 1, configuration, 
+                        right.data(), rightSubtreeLengths, context);
+                fork_merge(encodeStream, begin, leftSize, leftSize >> 1, leadingRunLength, depth + 1, configuration, 
+                        left.data(), leftSubtreeLengths, context);
+            }
+            subtreeLengths.insert(subtreeLengths.end(), leftSubtreeLengths.begin(), leftSubtreeLengths.end());
+            subtreeLengths.insert(subtreeLengths.end(), rightSubtreeLengths.begin(), rightSubtreeLengths.end());
+
+            std::vector<encode_value_type> valuesToEncode(left.size() + right.size());
+            merge_symbol_lists(encodeStream, left.data(), right.data(), leftSize, rightSize, result, valuesToEncode.data(), depth);
+        }
+
+        if (isSubtree)
+            subtreeLengths.push_back(encodeStream.size() - startSize);
+    }
+
+
+    //==========================================================================
+    void push_wide
+    (
+        // push a value of up to 64 bits
+        m99_encode_stream & encodeStream,
+        std::uint64_t value,
+        std::uint32_t length
+    )
+    {
+        if (length > 32)
+        {
+            encodeStream.push(value, 32);
+            value >>= 32;
+            length -= 32;
+        }
+        encodeStream.push(value, length);
+    }
+
+
+    //==========================================================================
+    long double merge_bound
+    (
+        // worst case number of bits produced by the merge (excluding the header) for an input of 'size' symbols.
+        // a node of size 's' with 'k' distinct symbols emits one truncated binary code per symbol.  each
+        // code is no longer than its count and, by concavity of log2, the sum is also no more than
+        // k * (log2(s / k + 1) + 1) where k <= min(alphabet size, s).  summing that over the levels of the tree
+        // (2^d nodes of average size size / 2^d at depth d) gives the bound.
+        std::size_t size,
+        std::uint64_t alphabetSize
+    )
+    {
+        long double bits = 0;
+        for (std::size_t nodeCount = 1; ; nodeCount <<= 1)
+        {
+            long double nodeSize = ((long double)size / nodeCount);
+            long double k = (nodeSize < alphabetSize) ? nodeSize : alphabetSize;
+            long double nodeBits = (k * (std::log2((nodeSize / k) + 1) + 1));
+            bits += (nodeCount * ((nodeBits < nodeSize) ? nodeBits : nodeSize));
+            if (nodeSize <= 2)
+                break;
+        }
+        return bits;
+    }
+
+
+    //==========================================================================
+    template <typename symbol_type>
+    bool adaptive_merge
+    (
+        // high ratio mode.  merge the entire tree and range code the recorded decisions.  the coded bytes
+        // are pushed in reverse so that they are read in order by the decoder.  returns false (and pushes
+        // nothing) if the range coded tree would be larger than the bound for the flat coded tree.
+        m99_encode_stream & encodeStream,
+        symbol_type const * begin,
+        std::uint32_t totalSize,
+        std::uint32_t leftSize,
+        std::uint32_t leadingRunLength,
+        symbol_info * result,
+        m99_encode_context::workspace_type & workspace
+    )
+    {
+        std::uint64_t maxNodeSize = 1;
+        while (maxNodeSize < totalSize)
+            maxNodeSize <<= 1;
+        auto & arena = workspace.arena_;
+        auto & recorder = workspace.recorder_;
+        arena.reset(maxNodeSize, alphabet_size<symbol_type>);
+        recorder.clear();
+        merge(recorder, begin, totalSize, leftSize, leadingRunLength, 0, arena);
+        copy_symbol_list(arena.get(0, 0), totalSize, result);
+
+        auto const & encoded = recorder.encode();
+        if ((encoded.size() * 8) > merge_bound(totalSize, alphabet_size<symbol_type>))
+            return false;
+        for (auto iter = encoded.rbegin(); iter != encoded.rend(); ++iter)
+            encodeStream.push(*iter, 8);
+        return true;
+    }
+
+    //==========================================================================
+    template <typename symbol_type>
+    void encode
+    (
+        symbol_type const * begin,
+        symbol_type const * end,
+        m99_encode_stream & encodeStream,
+        m99_encode_options const & options
+    )
+    {
+        // determine initial merge boundary (left size is largest power of 2 that is less than the input size).
+        std::uint32_t symbolsToEncode = std::distance(begin, end);
+        std::uint64_t leftSize = 1;
+        while (leftSize < symbolsToEncode)
+            leftSize <<= 1;
+
+        // fork enough levels to give every thread at least one subtree
+        std::uint32_t forkDepth = 0;
+        while ((1ull << forkDepth) < options.numThreads_)
+            ++forkDepth;
+
+        // do depth first merge and encode
+        // the root symbol list and subtree lengths are taken from the context and reused so that encoding a 
+        // stream of blocks reaches a steady state without allocations
+        auto & context = ((options.context_ != nullptr) ? *options.context_ : default_context());
+        auto workspace = context.acquire();
+        auto leadingRunLength = m99_run_length(begin, end);
+        auto & symbolList = workspace->symbolList_;
+        auto & subtreeLengths = workspace->subtreeLengths_;
+        auto symbolListSize = (std::min<std::uint64_t>(symbolsToEncode, alphabet_size<symbol_type>) + 1);
+        if (symbolList.size() < symbolListSize)
+            symbolList.resize(symbolListSize);
+        subtreeLengths.clear();
+        auto adaptiveCoded = (options.adaptiveCoding_ && 
+                adaptive_merge(encodeStream, begin, symbolsToEncode, leftSize >> 1, leadingRunLength, symbolList.data(), *workspace));
+        if (!adaptiveCoded)
+            fork_merge(encodeStream, begin, symbolsToEncode, leftSize >> 1, leadingRunLength, 0, 
+                    {forkDepth, options.adaptiveCoding_ ? 0 : options.splitDepth_}, symbolList.data(), subtreeLengths, context);
+
+        if (options.adaptiveCoding_)
+        {
+            // flag indicating whether the tree was range coded or (in the rare case where that would 
+            // expand the data) flat coded
+            encodeStream.push(adaptiveCoded, 1);
+        }
+        else if (options.splitDepth_ > 0)
+        {
+            // encode the subtree length table.  this is decoded ahead of the tree so that a decoder can 
+            // locate each subtree at the split depth and decode them independently.
+            std::uint32_t lengthSize = 1;
+            for (auto subtreeLength : subtreeLengths)
+                while ((subtreeLength >> lengthSize) != 0)
+                    ++lengthSize;
+            for (auto iter = subtreeLengths.rbegin(); iter != subtreeLengths.rend(); ++iter)
+                push_wide(encodeStream, *iter, lengthSize);
+            encodeStream.push(lengthSize, 6);
+            encodeStream.push(subtreeLengths.size(), 32);
+        }
+
+        // encode the symbols and their counts.  symbols are stored at their full width.  the header is pushed 
+        // from the last symbol to the first and the count of each symbol is coded against the total count of 
+        // that symbol and those which follow it.
+        auto symbolListEnd = symbolList.data();
+        for (auto n = symbolsToEncode; n > 0; n -= (symbolListEnd++)->count_)
+            ;
+        std::uint32_t maxCount = 0;
+        for (auto symbolInfo = symbolListEnd; symbolInfo-- != symbolList.data(); )
+        {
+            maxCount += symbolInfo->count_;
+            encodeStream.push(symbolInfo->symbol_, sizeof(symbol_type) * 8);
+            pack_value(encodeStream, symbolInfo->count_, maxCount, maxCount, maxCount);
+        }
+        encodeStream.push(1, 1);
+    }
+
+
+    //==========================================================================
+    template <typename symbol_type>
+    std::size_t encoded_size
+    (
+        symbol_type const * begin,
+        symbol_type const * end
+    )
+    {
+        // the same merge as encode (with default options) but into a bit_counter
+        std::uint32_t symbolsToEncode = std::distance(begin, end);
+        std::uint64_t leftSize = 1;
+        while (leftSize < symbolsToEncode)
+            leftSize <<= 1;
+        bit_counter bitCounter;
+        auto workspace = default_context().acquire();
+        auto & arena = workspace->arena_;
+        arena.reset(leftSize, alphabet_size<symbol_type>);
+        merge(bitCounter, begin, symbolsToEncode, leftSize >> 1, m99_run_length(begin, end), 0, arena);
+
+        // header and start of stream marker
+        auto symbolListEnd = arena.get(0, 0);
+        for (auto n = symbolsToEncode; n > 0; n -= (symbolListEnd++)->count_)
+            ;
+        std::uint32_t maxCount = 0;
+        for (auto symbolInfo = symbolListEnd; symbolInfo-- != arena.get(0, 0); )
+        {
+            maxCount += symbolInfo->count_;
+            bitCounter.push(symbolInfo->symbol_, sizeof(symbol_type) * 8);
+            pack_value(bitCounter, symbolInfo->count_, maxCount, maxCount, maxCount, 0);
         }
+        bitCounter.push(1, 1);
+        return bitCounter.size();
     }
 
 } // namespace
@@ -227,40 +959,217 @@ void maniscalco::m99_encode
     std::uint8_t const * begin,
     std::uint8_t const * end,
     m99_encode_stream & encodeStream
+)
+{
+    encode(begin, end, encodeStream, {});
+}
+
 
+//==========================================================================
+void maniscalco::m99_encode
+(
+    std::uint8_t const * begin,
+    std::uint8_t const * end,
+    m99_encode_stream & encodeStream,
+    m99_encode_options const & options
 )
 {
-    // determine initial merge boundary (left size is largest power of 2 that is less than the input size).
-    std::uint32_t bytesToEncode = std::distance(begin, end);
-    std::uint32_t leftSize = 1;
-    while (leftSize < bytesToEncode)
-        leftSize <<= 1;
-    symbol_info symbolList[256];
-
-    // do recursive merge and encode
-    auto cur = begin;
-    auto s = *cur;
-    while ((cur < end) && (*cur == s))
-        ++cur;
-    auto leadingRunLength = std::distance(begin, cur);
-    merge(encodeStream, begin, bytesToEncode, leftSize >> 1, symbolList, leadingRunLength);
-
-    // encode the symbols and their counts 
-    auto n = bytesToEncode;
-    std::vector<std::tuple<std::uint8_t, std::uint32_t, std::uint32_t>> headerValuesToEncode;
-    headerValuesToEncode.reserve(256);
-    for (auto & symbolInfo : symbolList)
+    encode(begin, end, encodeStream, options);
+}
+
+
+//==========================================================================
+void maniscalco::m99_encode
+(
+    std::uint16_t const * begin,
+    std::uint16_t const * end,
+    m99_encode_stream & encodeStream
+)
+{
+    encode(begin, end, encodeStream, {});
+}
+
+
+//==========================================================================
+void maniscalco::m99_encode
+(
+    std::uint16_t const * begin,
+    std::uint16_t const * end,
+    m99_encode_stream & encodeStream,
+    m99_encode_options const & options
+)
+{
+    encode(begin, end, encodeStream, options);
+}
+
+
+//==========================================================================
+void maniscalco::m99_encode
+(
+    std::uint32_t const * begin,
+    std::uint32_t const * end,
+    m99_encode_stream & encodeStream
+)
+{
+    encode(begin, end, encodeStream, {});
+}
+
+
+//==========================================================================
+void maniscalco::m99_encode
+(
+    std::uint32_t const * begin,
+    std::uint32_t const * end,
+    m99_encode_stream & encodeStream,
+    m99_encode_options const & options
+)
+{
+    encode(begin, end, encodeStream, options);
+}
+
+
+//==========================================================================
+std::size_t maniscalco::m99_encoded_size
+(
+    // returns the exact number of bits that m99_encode (with default options) produces for [begin, end).
+    // the merge is run as it would be for encoding but only the lengths of the codes are summed so this is
+    // considerably cheaper than encoding.  the encoding occupies ((bits + 7) / 8) bytes.
+    std::uint8_t const * begin,
+    std::uint8_t const * end
+)
+{
+    return encoded_size(begin, end);
+}
+
+
+//==========================================================================
+std::size_t maniscalco::m99_encoded_size
+(
+    std::uint16_t const * begin,
+    std::uint16_t const * end
+)
+{
+    return encoded_size(begin, end);
+}
+
+
+//==========================================================================
+std::size_t maniscalco::m99_encoded_size
+(
+    std::uint32_t const * begin,
+    std::uint32_t const * end
+)
+{
+    return encoded_size(begin, end);
+}
+
+
+//==========================================================================
+std::size_t maniscalco::m99_encode_bound
+(
+    // returns the worst case number of bytes that m99_encode can produce for an input of 'size' bytes.
+    std::size_t size
+)
+{
+    return m99_encode_bound<std::uint8_t>(size, {});
+}
+
+
+//==========================================================================
+std::size_t maniscalco::m99_encode_bound
+(
+    std::size_t size,
+    m99_encode_options const & options
+)
+{
+    return m99_encode_bound<std::uint8_t>(size, options);
+}
+
+
+//==========================================================================
+template <typename symbol_type>
+std::size_t maniscalco::m99_encode_bound
+(
+    // returns the worst case number of bytes that m99_encode can produce for an input of 'size' symbols.
+    // this is the bound on the merge plus the header plus the subtree length table when 
+    // options.splitDepth_ is non zero.  the table holds at most min(2^splitDepth_, size) lengths of 
+    // no more than 64 bits each.  in high ratio mode the range coded tree is never larger than the 
+    // bound on the flat coded tree so only the flag which selects between the two is added.
+    std::size_t size,
+    m99_encode_options const & options
+)
+{
+    auto alphabetSize = alphabet_size<symbol_type>;
+    auto bits = merge_bound(size, alphabetSize);
+    auto headerSymbolCount = std::min<std::uint64_t>(size, alphabetSize);
+    bits += (headerSymbolCount * ((sizeof(symbol_type) * 8) + 32)) + 1; // header and start of stream marker
+    auto bound = ((std::size_t)std::ceil(bits / 8) + 8);
+    if (options.adaptiveCoding_)
+        bound += 1;
+    else if (options.splitDepth_ > 0)
     {
-        if (n == 0)
-            break;
-        headerValuesToEncode.push_back({symbolInfo.symbol_, symbolInfo.count_, n});
-        n -= symbolInfo.count_;
+        std::size_t maxSubtreeCount = ((options.splitDepth_ < 32) ? (1ull << options.splitDepth_) : size);
+        bound += ((((maxSubtreeCount < size) ? maxSubtreeCount : size) * 8) + 5); // lengths, length size and count
     }
-    std::reverse(headerValuesToEncode.begin(), headerValuesToEncode.end());
-    for (auto [symbol, count, maxCount] : headerValuesToEncode)
+    return bound;
+}
+
+
+//==========================================================================
+void maniscalco::m99_encode_context::workspace_releaser::operator ()
+(
+    workspace_type * workspace
+) const
+{
+    std::lock_guard lockGuard(context_->mutex_);
+    context_->available_.emplace_back(workspace);
+}
+
+
+//==========================================================================
+maniscalco::m99_encode_context::m99_encode_context
+(
+)
+{
+}
+
+
+//==========================================================================
+maniscalco::m99_encode_context::~m99_encode_context
+(
+)
+{
+}
+
+
+//==========================================================================
+auto maniscalco::m99_encode_context::acquire
+(
+    // takes a workspace which is not in use (or creates one if there are none)
+) -> workspace_handle
+{
+    std::unique_lock uniqueLock(mutex_);
+    if (available_.empty())
     {
-        encodeStream.push(symbol, 8);
-        pack_value(encodeStream, count, maxCount, maxCount, maxCount);
+        uniqueLock.unlock();
+        return workspace_handle(new workspace_type, {this});
     }
-    encodeStream.push(1, 1);
+    auto workspace = available_.back().release();
+    available_.pop_back();
+    return workspace_handle(workspace, {this});
 }
+
+
+//==========================================================================
+auto maniscalco::m99_encode_context::buffer_pool
+(
+    // the pool from which the scratch streams of the parallel merge are taken
+) -> m99_buffer_pool &
+{
+    return bufferPool_;
+}
+
+
+template std::size_t maniscalco::m99_encode_bound<std::uint8_t>(std::size_t, m99_encode_options const &);
+template std::size_t maniscalco::m99_encode_bound<std::uint16_t>(std::size_t, m99_encode_options const &);
+template std::size_t maniscalco::m99_encode_bound<std::uint32_t>(std::size_t, m99_encode_options const &);
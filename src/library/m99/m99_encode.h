@@ -1,19 +1,168 @@
 #pragma once
 
+#include "./m99_buffer_pool.h"
 #include "./m99_encode_stream.h"
 
 #include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 
 namespace maniscalco
 {
 
+    // working state of the encoder: the symbol lists of the merge, the decisions of the adaptive coder and the
+    // streams into which the parallel merge encodes its left subtrees.  each encode (and each subtree merged on a
+    // thread of its own) takes a workspace from the context and returns it when done so a context which encodes a
+    // stream of blocks reaches a steady state in which nothing is allocated.  encodes may share a context concurrently.
+    class m99_encode_context
+    {
+    public:
+
+        struct workspace_type;
+
+        struct workspace_releaser
+        {
+            void operator ()
+            (
+                workspace_type *
+            ) const;
+
+            m99_encode_context * context_;
+        };
+
+        // a workspace for the sole use of its holder.  destroying the handle returns the workspace to the context.
+        using workspace_handle = std::unique_ptr<workspace_type, workspace_releaser>;
+
+        m99_encode_context();
+
+        m99_encode_context(m99_encode_context const &) = delete;
+
+        m99_encode_context & operator = (m99_encode_context const &) = delete;
+
+        ~m99_encode_context();
+
+        workspace_handle acquire();
+
+        m99_buffer_pool & buffer_pool();
+
+    private:
+
+        std::mutex mutex_;
+
+        std::vector<std::unique_ptr<workspace_type>> available_;
+
+        m99_buffer_pool bufferPool_;
+
+    };
+
+
+    struct m99_encode_options
+    {
+        // number of threads used to encode the top levels of the merge tree in parallel.
+        // the encoded output is identical for any number of threads.
+        std::size_t numThreads_{1};
+
+        // when non zero the encoded length of every subtree at this depth is recorded ahead of the tree
+        // so that the subtrees can be decoded independently (and in parallel).  up to 2^splitDepth_
+        // subtrees are recorded.  the decoder must be given the same split depth.
+        std::uint32_t splitDepth_{0};
+
+        // high ratio mode.  the tree is range coded using adaptive models rather than flat truncated binary codes.
+        // this gives better compression at the cost of slower encoding and decoding.  the tree is merged on a 
+        // single thread and splitDepth_ is ignored.  the decoder must be told that the stream uses this mode.
+        bool adaptiveCoding_{false};
+
+        // the working state to encode with.  when null a context shared by the whole process is used.
+        m99_encode_context * context_{nullptr};
+    };
+
+    void m99_encode
+    (
+        std::uint8_t const *,
+        std::uint8_t const *,
+        m99_encode_stream &
+    );
+
     void m99_encode
     (
         std::uint8_t const *,
         std::uint8_t const *,
+        m99_encode_stream &,
+        m99_encode_options const &
+    );
+
+    // wide symbol variants.  symbols are coded exactly as bytes are but the symbol lists within the
+    // tree are sparse so the cost depends on the number of distinct symbols rather than the alphabet size.
+    void m99_encode
+    (
+        std::uint16_t const *,
+        std::uint16_t const *,
         m99_encode_stream &
     );
 
+    void m99_encode
+    (
+        std::uint16_t const *,
+        std::uint16_t const *,
+        m99_encode_stream &,
+        m99_encode_options const &
+    );
+
+    void m99_encode
+    (
+        std::uint32_t const *,
+        std::uint32_t const *,
+        m99_encode_stream &
+    );
+
+    void m99_encode
+    (
+        std::uint32_t const *,
+        std::uint32_t const *,
+        m99_encode_stream &,
+        m99_encode_options const &
+    );
+
+    // exact size (in bits) of the encoding that m99_encode produces with default options, computed without encoding
+    std::size_t m99_encoded_size
+    (
+        std::uint8_t const *,
+        std::uint8_t const *
+    );
+
+    std::size_t m99_encoded_size
+    (
+        std::uint16_t const *,
+        std::uint16_t const *
+    );
+
+    std::size_t m99_encoded_size
+    (
+        std::uint32_t const *,
+        std::uint32_t const *
+    );
+
+    std::size_t m99_encode_bound
+    (
+        std::size_t
+    );
+
+    std::size_t m99_encode_bound
+    (
+        std::size_t,
+        m99_encode_options const &
+    );
+
+    // bound for an input of the given number of symbols of type std::uint8_t, std::uint16_t or std::uint32_t
+    template <typename symbol_type>
+    std::size_t m99_encode_bound
+    (
+        std::size_t,
+        m99_encode_options const & = {}
+    );
+
 } // namespace maniscalco
 
@@ -16,6 +16,25 @@ maniscalco::m99_encode_stream::m99_encode_stream
 }
 
 
+//=============================================================================
+maniscalco::m99_encode_stream::m99_encode_stream
+(
+    // contiguous mode.  encode into the caller provided range [begin, end)
+    // which must be at least m99_encode_bound() bytes for the data to be encoded.
+    std::uint8_t * begin,
+    std::uint8_t * end
+):
+    stream_({
+        .bufferOutputHandler_ = [](packet_type){},
+        .bufferAllocationHandler_ = [](){return maniscalco::buffer();}
+    }),
+    regionBegin_(begin),
+    regionEnd_(end),
+    cursor_(end)
+{
+}
+
+
 //=============================================================================
 auto maniscalco::m99_encode_stream::begin
 (
@@ -39,17 +58,60 @@ void maniscalco::m99_encode_stream::clear
 (
 )
 {
-    stream_.flush();
-    packets_.clear();
+    if (cursor_ == nullptr)
+    {
+        stream_.flush();
+        packets_.clear();
+        return;
+    }
+    cursor_ = regionEnd_;
+    accumulator_ = 0;
+    accumulatorSize_ = 0;
+    paddingSize_ = 0;
 }
 
 
 //=============================================================================
 void maniscalco::m99_encode_stream::flush
 (
-)   
+)
+{
+    if (cursor_ == nullptr)
+    {
+        stream_.flush();
+        return;
+    }
+    // write out any pending bits.  the first byte is padded with leading zeros.
+    paddingSize_ += ((8 - (accumulatorSize_ & 7)) & 7);
+    while (accumulatorSize_ > 0)
+    {
+        *--cursor_ = (std::uint8_t)accumulator_;
+        accumulator_ >>= 8;
+        accumulatorSize_ -= (accumulatorSize_ > 8) ? 8 : accumulatorSize_;
+    }
+}
+
+
+//=============================================================================
+void maniscalco::m99_encode_stream::append
+(
+    // bit level concatenation.  push all bits of 'other' (which must be an unflushed contiguous
+    // mode stream) as though they had been pushed directly into this stream.
+    m99_encode_stream const & other
+)
 {
-    stream_.flush();
+    // the earliest pushed bits of 'other' are at the end of its range so push from the end backwards
+    auto current = other.regionEnd_;
+    while (std::distance(other.cursor_, current) >= 4)
+    {
+        current -= 4;
+        std::uint32_t word;
+        std::memcpy(&word, current, sizeof(word));
+        push(__builtin_bswap32(word), 32);
+    }
+    while (current > other.cursor_)
+        push(*--current, 8);
+    push(other.accumulator_, other.accumulatorSize_);
 }
 
 
@@ -58,5 +120,17 @@ auto maniscalco::m99_encode_stream::size
 (
 ) const -> size_type
 {
-    return stream_.size();
-}
\ No newline at end of file
+    if (cursor_ == nullptr)
+        return stream_.size();
+    return ((std::distance(cursor_, regionEnd_) * 8) + accumulatorSize_ - paddingSize_);
+}
+
+
+//=============================================================================
+std::uint8_t const * maniscalco::m99_encode_stream::data
+(
+) const
+{
+    // contiguous mode only.  after flush the encoding is [data(), data() + ((size() + 7) / 8))
+    return cursor_;
+}
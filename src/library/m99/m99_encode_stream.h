@@ -3,6 +3,7 @@
 #include <library/io.h>
 
 #include <cstdint>
+#include <cstring>
 #include <queue>
 
 
@@ -24,11 +25,27 @@ namespace maniscalco
 
         m99_encode_stream();
 
-        template <typename ... T>
-        auto push(T && ... args);
+        m99_encode_stream
+        (
+            std::uint8_t *,
+            std::uint8_t *
+        );
+
+        void push
+        (
+            std::uint64_t,
+            std::size_t
+        );
+
+        void append
+        (
+            m99_encode_stream const &
+        );
 
         size_type size() const;
 
+        std::uint8_t const * data() const;
+
         const_iterator begin() const;
 
         const_iterator end() const;
@@ -40,9 +57,24 @@ namespace maniscalco
     //private:
 
         container_type packets_;
-        
+
         stream_type stream_;
 
+        // contiguous mode.  bits are written backwards from regionEnd_ towards regionBegin_
+        // so that the final encoding is the single range [cursor_, regionEnd_)
+        std::uint8_t * regionBegin_{nullptr};
+
+        std::uint8_t * regionEnd_{nullptr};
+
+        std::uint8_t * cursor_{nullptr};
+
+        // pending bits.  the lowest bit is the last bit of the pending bits in stream order.
+        std::uint64_t accumulator_{0};
+
+        std::size_t accumulatorSize_{0};
+
+        std::size_t paddingSize_{0};
+
     }; // class m99_encode_stream
 
 
@@ -50,11 +82,26 @@ namespace maniscalco
 
 
 //=============================================================================
-template <typename ... T>
-auto maniscalco::m99_encode_stream::push
+inline void maniscalco::m99_encode_stream::push
 (
-    T && ... args
+    // push the low 'codeLength' bits (codeLength <= 32) of 'code'
+    std::uint64_t code,
+    std::size_t codeLength
 )
 {
-    return stream_.push(std::forward<T>(args) ...);
+    if (cursor_ == nullptr)
+    {
+        stream_.push(code, codeLength);
+        return;
+    }
+    accumulator_ |= ((code & ((1ull << codeLength) - 1)) << accumulatorSize_);
+    accumulatorSize_ += codeLength;
+    if (accumulatorSize_ >= 32)
+    {
+        auto word = __builtin_bswap32((std::uint32_t)accumulator_);
+        cursor_ -= sizeof(word);
+        std::memcpy(cursor_, &word, sizeof(word));
+        accumulator_ >>= 32;
+        accumulatorSize_ -= 32;
+    }
 }
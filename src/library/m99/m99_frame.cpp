@@ -0,0 +1,489 @@
+#include "./m99_frame.h"
+#include "./m99_crc32c.h"
+#include "./m99_decode.h"
+#include "./m99_encode.h"
+#include "./m99_inverse_bwt.h"
+#include "./m99_thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+
+namespace
+{
+
+    //==================================================================================================================
+    bool decode_sub_block
+    (
+        maniscalco::m99_encoded_block const & encodedBlock,
+        std::size_t subBlockId,
+        std::uint8_t * outputBegin,
+        std::uint8_t * outputEnd,
+        std::uint32_t * symbolCounts,
+        maniscalco::m99_decode_options decodeOptions
+    )
+    {
+        std::size_t subBlockSize = encodedBlock.header_.subBlockSize_;
+        auto destinationBegin = (outputBegin + (subBlockId * subBlockSize));
+        auto destinationEnd = std::min(destinationBegin + subBlockSize, outputEnd);
+        auto encodedBegin = (encodedBlock.encodedData_ + encodedBlock.subBlockOffset_[subBlockId]);
+        auto encodedEnd = (encodedBlock.encodedData_ + encodedBlock.subBlockOffset_[subBlockId + 1]);
+        // the decoder trusts its input so corrupt data is rejected before it is decoded
+        if ((!encodedBlock.subBlockChecksum_.empty()) && 
+                (maniscalco::m99_crc32c(encodedBegin, std::distance(encodedBegin, encodedEnd)) != encodedBlock.subBlockChecksum_[subBlockId]))
+            return false;
+        maniscalco::m99_decode_stream decodeStream(encodedBegin, encodedEnd);
+        decodeOptions.symbolCounts_ = (symbolCounts + (subBlockId * maniscalco::m99_inverse_bwt_alphabet_size));
+        return maniscalco::m99_decode(decodeStream, destinationBegin, destinationEnd, decodeOptions);
+    }
+
+
+    //==================================================================================================================
+    std::uint64_t table_size
+    (
+        // bytes of the sub block index and checksums which follow a block header
+        maniscalco::m99_block_header const & blockHeader
+    )
+    {
+        std::uint64_t subBlockCount = blockHeader.subBlockCount_;
+        auto size = (subBlockCount * sizeof(maniscalco::m99_sub_block_index_entry));
+        if (blockHeader.flags_ & maniscalco::m99_block_flag_checksums)
+            size += ((subBlockCount + 1) * sizeof(maniscalco::m99_checksum));
+        return size;
+    }
+
+
+    //==================================================================================================================
+    bool is_within_limits
+    (
+        // checks a (valid) block header against the frame's maximum block size and against the bytes of the input
+        // which follow the header before the index and checksums which it claims are allocated
+        maniscalco::m99_block_header const & blockHeader,
+        std::uint32_t maxBlockSize,
+        std::uint64_t bytesRemaining
+    )
+    {
+        return ((blockHeader.blockSize_ <= maxBlockSize) && (table_size(blockHeader) <= bytesRemaining));
+    }
+
+
+    //==================================================================================================================
+    bool set_sub_block_offsets
+    (
+        // the offset of each sub block within the block's encoded data.  returns false if any sub block claims to be
+        // larger than the encoder could have made it.
+        maniscalco::m99_block_header const & blockHeader,
+        std::vector<maniscalco::m99_sub_block_index_entry> const & index,
+        std::vector<std::uint64_t> & subBlockOffset
+    )
+    {
+        auto maxEncodedSize = maniscalco::m99_encode_bound(blockHeader.subBlockSize_, {.splitDepth_ = blockHeader.splitDepth_,
+                .adaptiveCoding_ = ((blockHeader.flags_ & maniscalco::m99_block_flag_adaptive_coding) != 0)});
+        subBlockOffset.resize(index.size() + 1);
+        subBlockOffset[0] = 0;
+        for (std::size_t i = 0; i < index.size(); ++i)
+        {
+            if (index[i].encodedSize_ > maxEncodedSize)
+                return false;
+            subBlockOffset[i + 1] = (subBlockOffset[i] + index[i].encodedSize_);
+        }
+        return true;
+    }
+
+    //==================================================================================================================
+    bool read_frame_block_index
+    (
+        // reads the block index which the frame trailer locates.  'frameStart' is the position of the frame within
+        // the stream and 'frameSize' is the number of bytes from there to the end of the stream.  every entry is
+        // checked against its neighbours and the frame before any block is located by it.
+        std::istream & inStream,
+        std::uint64_t frameStart,
+        std::uint64_t frameSize,
+        maniscalco::m99_frame_header const & frameHeader,
+        std::vector<maniscalco::m99_block_location> & blockLocations
+    )
+    {
+        static auto constexpr first_block_position = sizeof(maniscalco::m99_frame_header);
+        static auto constexpr min_frame_size = (first_block_position + sizeof(maniscalco::m99_block_header) + 
+                sizeof(maniscalco::m99_frame_trailer));
+
+        maniscalco::m99_frame_trailer frameTrailer;
+        if ((frameSize < min_frame_size) || 
+                (!inStream.seekg(frameStart + frameSize - sizeof(frameTrailer), std::ios_base::beg)) ||
+                (!inStream.read((char *)&frameTrailer, sizeof(frameTrailer))) ||
+                (frameTrailer.magic_ != maniscalco::m99_frame_trailer_magic))
+            return false;
+        // the index must lie between the end of frame marker and the trailer and fill that space exactly
+        std::uint64_t indexPosition = frameTrailer.indexPosition_;
+        std::uint64_t indexSize = ((std::uint64_t)frameTrailer.blockCount_ * sizeof(maniscalco::m99_block_index_entry));
+        if ((indexPosition < (first_block_position + sizeof(maniscalco::m99_block_header))) || 
+                (indexPosition > (frameSize - sizeof(frameTrailer))) ||
+                (indexSize != (frameSize - sizeof(frameTrailer) - indexPosition)))
+            return false;
+        std::vector<maniscalco::m99_block_index_entry> index(frameTrailer.blockCount_);
+        if ((!inStream.seekg(frameStart + indexPosition, std::ios_base::beg)) || (!inStream.read((char *)index.data(), indexSize)))
+            return false;
+
+        // each block ends where the next begins (the last at the end of frame marker) and decodes to the data
+        // up to the next block's offset (the last to the end of the data)
+        std::uint64_t endOfBlocks = (indexPosition - sizeof(maniscalco::m99_block_header));
+        std::uint64_t decodedSize = frameTrailer.decodedSize_;
+        std::uint64_t position = first_block_position;
+        std::uint64_t decodedOffset = 0;
+        blockLocations.reserve(index.size());
+        for (std::size_t i = 0; i < index.size(); ++i)
+        {
+            auto nextPosition = ((i + 1) < index.size()) ? index[i + 1].position_.get() : endOfBlocks;
+            auto nextDecodedOffset = ((i + 1) < index.size()) ? index[i + 1].decodedOffset_.get() : decodedSize;
+            if ((index[i].position_ != position) || (index[i].decodedOffset_ != decodedOffset) ||
+                    (nextPosition < (position + sizeof(maniscalco::m99_block_header))) || (nextPosition > endOfBlocks) ||
+                    (nextDecodedOffset <= decodedOffset) || ((nextDecodedOffset - decodedOffset) > frameHeader.maxBlockSize_))
+                return false;
+            blockLocations.push_back({frameStart + position, nextPosition - position, decodedOffset, 
+                    (std::uint32_t)(nextDecodedOffset - decodedOffset)});
+            position = nextPosition;
+            decodedOffset = nextDecodedOffset;
+        }
+        return ((position == endOfBlocks) && (decodedOffset == decodedSize));
+    }
+
+
+    //==================================================================================================================
+    bool walk_block_headers
+    (
+        // the fallback for a stream which can not seek.  builds the location of every block by reading each block's
+        // header and sub block index and skipping its encoded data.  the stream is positioned after the frame
+        // header.  such a stream has no position of its own so the positions are relative to the frame.
+        std::istream & inStream,
+        maniscalco::m99_frame_header const & frameHeader,
+        std::vector<maniscalco::m99_block_location> & blockLocations
+    )
+    {
+        std::uint64_t position = sizeof(frameHeader);
+        std::uint64_t decodedOffset = 0;
+        std::vector<maniscalco::m99_sub_block_index_entry> index;
+        std::vector<std::uint64_t> subBlockOffset;
+        while (true)
+        {
+            maniscalco::m99_block_header blockHeader;
+            if (!inStream.read((char *)&blockHeader, sizeof(blockHeader)))
+                return false;
+            if (maniscalco::m99_is_end_of_frame(blockHeader))
+                return true;
+            if ((!maniscalco::m99_is_valid(blockHeader)) || (!is_within_limits(blockHeader, frameHeader.maxBlockSize_, ~0ull)))
+                return false;
+            index.resize(blockHeader.subBlockCount_);
+            if (!inStream.read((char *)index.data(), index.size() * sizeof(maniscalco::m99_sub_block_index_entry)) || 
+                    !set_sub_block_offsets(blockHeader, index, subBlockOffset))
+                return false;
+            auto checksumSize = (table_size(blockHeader) - (index.size() * sizeof(maniscalco::m99_sub_block_index_entry)));
+            if (!inStream.ignore(checksumSize + subBlockOffset.back()))
+                return false;
+            std::uint64_t encodedSize = (sizeof(blockHeader) + table_size(blockHeader) + subBlockOffset.back());
+            blockLocations.push_back({position, encodedSize, decodedOffset, blockHeader.blockSize_});
+            decodedOffset += blockHeader.blockSize_;
+            position += encodedSize;
+        }
+    }
+
+} // namespace
+
+
+//======================================================================================================================
+bool maniscalco::m99_read_block
+(
+    // reads the next block header, its sub block index and all of its encoded data.  the stream is only read
+    // (never seeked) so it may be a pipe.  returns false if the block is malformed, truncated or exceeds 'limits'
+    // (whose bytes remaining are reduced by the size of the block).  at the end of the frame this returns true
+    // with a header for which m99_is_end_of_frame is true and no data.
+    std::istream & inStream,
+    m99_frame_limits & limits,
+    m99_encoded_block & encodedBlock,
+    m99_buffer_pool & bufferPool
+)
+{
+    auto & blockHeader = encodedBlock.header_;
+    if ((limits.bytesRemaining_ < sizeof(blockHeader)) || (!inStream.read((char *)&blockHeader, sizeof(blockHeader))))
+        return false;
+    limits.bytesRemaining_ -= sizeof(blockHeader);
+    if (m99_is_end_of_frame(blockHeader))
+    {
+        encodedBlock.data_.release();
+        encodedBlock.encodedData_ = nullptr;
+        encodedBlock.subBlockOffset_.assign(1, 0);
+        encodedBlock.subBlockChecksum_.clear();
+        encodedBlock.checksum_ = 0;
+        return true;
+    }
+    if ((!m99_is_valid(blockHeader)) || (!is_within_limits(blockHeader, limits.maxBlockSize_, limits.bytesRemaining_)))
+        return false;
+    limits.bytesRemaining_ -= table_size(blockHeader);
+
+    std::vector<m99_sub_block_index_entry> index(blockHeader.subBlockCount_);
+    if (!inStream.read((char *)index.data(), index.size() * sizeof(m99_sub_block_index_entry)))
+        return false;
+    auto & subBlockOffset = encodedBlock.subBlockOffset_;
+    if (!set_sub_block_offsets(blockHeader, index, subBlockOffset))
+        return false;
+
+    encodedBlock.subBlockChecksum_.clear();
+    encodedBlock.checksum_ = 0;
+    if (blockHeader.flags_ & m99_block_flag_checksums)
+    {
+        std::vector<m99_checksum> checksums(index.size() + 1);
+        if (!inStream.read((char *)checksums.data(), checksums.size() * sizeof(m99_checksum)))
+            return false;
+        encodedBlock.subBlockChecksum_.assign(checksums.begin(), checksums.end() - 1);
+        encodedBlock.checksum_ = checksums.back();
+    }
+
+    if (subBlockOffset.back() > limits.bytesRemaining_)
+        return false;
+    limits.bytesRemaining_ -= subBlockOffset.back();
+    encodedBlock.data_ = bufferPool.acquire(subBlockOffset.back());
+    encodedBlock.encodedData_ = encodedBlock.data_.data();
+    return (bool)inStream.read((char *)encodedBlock.data_.data(), encodedBlock.data_.size());
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_view_block
+(
+    // the in memory counterpart of m99_read_block for a frame which is entirely in memory (a mapped file).
+    // the block at 'current' is parsed and its encoded data is referenced where it lies rather than copied so
+    // the frame must outlive the block.  'current' is advanced past the block.  returns false if the block is
+    // malformed, larger than 'maxBlockSize' (from the frame header) or extends beyond 'end'.
+    std::uint8_t const * & current,
+    std::uint8_t const * end,
+    std::uint32_t maxBlockSize,
+    m99_encoded_block & encodedBlock
+)
+{
+    // the frame's fields are not aligned within memory so they are copied out rather than referenced
+    auto take = [&](void * destination, std::size_t size)
+            {
+                if (size > (std::size_t)std::distance(current, end))
+                    return false;
+                std::memcpy(destination, current, size);
+                current += size;
+                return true;
+            };
+
+    auto & blockHeader = encodedBlock.header_;
+    encodedBlock.data_.release();
+    encodedBlock.encodedData_ = nullptr;
+    encodedBlock.subBlockChecksum_.clear();
+    encodedBlock.checksum_ = 0;
+    if (!take(&blockHeader, sizeof(blockHeader)))
+        return false;
+    if (m99_is_end_of_frame(blockHeader))
+    {
+        encodedBlock.subBlockOffset_.assign(1, 0);
+        return true;
+    }
+    if ((!m99_is_valid(blockHeader)) || (!is_within_limits(blockHeader, maxBlockSize, std::distance(current, end))))
+        return false;
+
+    std::vector<m99_sub_block_index_entry> index(blockHeader.subBlockCount_);
+    if (!take(index.data(), index.size() * sizeof(m99_sub_block_index_entry)))
+        return false;
+    auto & subBlockOffset = encodedBlock.subBlockOffset_;
+    if (!set_sub_block_offsets(blockHeader, index, subBlockOffset))
+        return false;
+
+    if (blockHeader.flags_ & m99_block_flag_checksums)
+    {
+        std::vector<m99_checksum> checksums(index.size() + 1);
+        if (!take(checksums.data(), checksums.size() * sizeof(m99_checksum)))
+            return false;
+        encodedBlock.subBlockChecksum_.assign(checksums.begin(), checksums.end() - 1);
+        encodedBlock.checksum_ = checksums.back();
+    }
+
+    if (subBlockOffset.back() > (std::uint64_t)std::distance(current, end))
+        return false;
+    encodedBlock.encodedData_ = current;
+    current += subBlockOffset.back();
+    return true;
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_decode_block
+(
+    // decodes a block read by m99_read_block.  'output' receives header_.blockSize_ bytes.  returns false if any
+    // checksum does not match.
+    m99_encoded_block const & encodedBlock,
+    std::uint8_t * output,
+    std::size_t numThreads,
+    m99_buffer_pool & bufferPool
+)
+{
+    m99_decoded_block decodedBlock;
+    return (m99_decode_sub_blocks(encodedBlock, decodedBlock, numThreads, bufferPool) &&
+            m99_reverse_block(decodedBlock, output, numThreads, bufferPool));
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_decode_sub_blocks
+(
+    // decodes the sub blocks of a block read by m99_read_block producing the block's BWT.  the index locates
+    // every sub block so the sub blocks are decoded in parallel directly from the block's data.  if the block
+    // has checksums then each sub block is verified by the thread which decodes it.  returns false if any
+    // checksum does not match.
+    m99_encoded_block const & encodedBlock,
+    m99_decoded_block & decodedBlock,
+    std::size_t numThreads,
+    m99_buffer_pool & bufferPool
+)
+{
+    auto const & blockHeader = encodedBlock.header_;
+    numThreads = std::max<std::size_t>(numThreads, 1);
+    decodedBlock.header_ = blockHeader;
+    decodedBlock.hasChecksum_ = (!encodedBlock.subBlockChecksum_.empty());
+    decodedBlock.checksum_ = encodedBlock.checksum_;
+
+    // space for the BWT (reused from previous blocks where possible)
+    decodedBlock.bwt_ = bufferPool.acquire(blockHeader.blockSize_);
+    auto bwtBegin = decodedBlock.bwt_.data();
+    auto bwtEnd = (bwtBegin + decodedBlock.bwt_.size());
+
+    // the decoder reports the symbol counts of each sub block which the inverse BWT uses directly
+    std::size_t n = blockHeader.subBlockCount_;
+    decodedBlock.symbolCounts_ = bufferPool.acquire(n * m99_inverse_bwt_alphabet_size * sizeof(std::uint32_t));
+    auto symbolCounts = (std::uint32_t *)decodedBlock.symbolCounts_.data();
+
+    // when there are fewer sub blocks than threads the remaining threads are used to decode
+    // the independent subtrees within each sub block (if the block was encoded with a split depth)
+    m99_decode_options decodeOptions{.numThreads_ = ((n < numThreads) ? (numThreads / n) : 1),
+            .splitDepth_ = blockHeader.splitDepth_,
+            .adaptiveCoding_ = ((blockHeader.flags_ & m99_block_flag_adaptive_coding) != 0)};
+
+    std::atomic<bool> corrupt{false};
+    m99_thread_pool::instance().parallel_for(n, numThreads, [&](std::size_t subBlockId)
+            {
+                if (!decode_sub_block(encodedBlock, subBlockId, bwtBegin, bwtEnd, symbolCounts, decodeOptions))
+                    corrupt = true;
+            });
+    return !corrupt;
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_reverse_block
+(
+    // reverses the BWT of a block decoded by m99_decode_sub_blocks.  'output' receives header_.blockSize_ bytes.
+    // if the block has a checksum then the output is verified against it.  returns false if it does not match.
+    m99_decoded_block const & decodedBlock,
+    std::uint8_t * output,
+    std::size_t numThreads,
+    m99_buffer_pool & bufferPool
+)
+{
+    auto const & blockHeader = decodedBlock.header_;
+    auto bwtBegin = decodedBlock.bwt_.data();
+    auto bwtEnd = (bwtBegin + decodedBlock.bwt_.size());
+    m99_inverse_bwt(bwtBegin, bwtEnd, blockHeader.sentinelIndex_, blockHeader.subBlockSize_, 
+            (std::uint32_t const *)decodedBlock.symbolCounts_.data(), output, std::max<std::size_t>(numThreads, 1), bufferPool);
+    return ((!decodedBlock.hasChecksum_) || (m99_crc32c(output, blockHeader.blockSize_) == decodedBlock.checksum_));
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_read_block_index
+(
+    // builds the location of every block in the frame.  the stream must be positioned at the start of the frame.
+    // the locations are taken from the block index which the trailer at the end of the frame locates so none of
+    // the blocks are read.  a stream which can not seek (and so has no end to read the trailer from) falls back
+    // to walking the block headers instead.  returns false if the frame is malformed or truncated.
+    std::istream & inStream,
+    std::vector<m99_block_location> & blockLocations
+)
+{
+    blockLocations.clear();
+    auto frameStart = inStream.tellg();
+    m99_frame_header frameHeader;
+    if (!inStream.read((char *)&frameHeader, sizeof(frameHeader)) || !m99_is_valid(frameHeader))
+        return false;
+    if ((frameStart != std::istream::pos_type(-1)) && inStream.seekg(0, std::ios_base::end))
+        return read_frame_block_index(inStream, frameStart, inStream.tellg() - frameStart, frameHeader, blockLocations);
+    inStream.clear();
+    return walk_block_headers(inStream, frameHeader, blockLocations);
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_decode_range
+(
+    // decodes bytes [offset, offset + length) of the original data and passes them in order to 'consume'.  only
+    // the blocks which overlap the range are read (located via 'blockLocations' from m99_read_block_index).  they
+    // are read, decoded (using all of the threads within the block) and consumed one at a time so memory is
+    // bounded by the block size rather than by the length of the range.  returns false if the range extends
+    // beyond the data, a block is malformed or fails its checksums or 'consume' returns false.
+    std::istream & inStream,
+    std::vector<m99_block_location> const & blockLocations,
+    std::uint64_t offset,
+    std::uint64_t length,
+    m99_range_consumer const & consume,
+    std::size_t numThreads,
+    m99_buffer_pool & bufferPool
+)
+{
+    auto decodedSize = blockLocations.empty() ? 0 : (blockLocations.back().decodedOffset_ + blockLocations.back().decodedSize_);
+    if ((offset > decodedSize) || (length > (decodedSize - offset)))
+        return false;
+    if (length == 0)
+        return true;
+
+    // the blocks which overlap the range
+    auto first = std::upper_bound(blockLocations.begin(), blockLocations.end(), offset,
+            [](auto value, auto const & blockLocation){return (value < (blockLocation.decodedOffset_ + blockLocation.decodedSize_));});
+    auto last = std::lower_bound(first, blockLocations.end(), offset + length,
+            [](auto const & blockLocation, auto end){return (blockLocation.decodedOffset_ < end);});
+
+    // each block must be exactly the size which its location gives so nothing larger is allocated for it.  the
+    // buffers of each block are returned to the pool before the next block is read so that they are reused.
+    m99_encoded_block encodedBlock;
+    for (auto blockLocation = first; blockLocation != last; ++blockLocation)
+    {
+        inStream.clear();
+        inStream.seekg(blockLocation->position_, std::ios_base::beg);
+        m99_frame_limits limits{.maxBlockSize_ = blockLocation->decodedSize_, .bytesRemaining_ = blockLocation->encodedSize_};
+        if ((!m99_read_block(inStream, limits, encodedBlock, bufferPool)) || (limits.bytesRemaining_ != 0) ||
+                (encodedBlock.header_.blockSize_ != blockLocation->decodedSize_))
+            return false;
+        auto decoded = bufferPool.acquire(blockLocation->decodedSize_);
+        if (!m99_decode_block(encodedBlock, decoded.data(), numThreads, bufferPool))
+            return false;
+        encodedBlock.data_.release();
+        // the part of the block which lies within the range
+        auto begin = std::max(offset, blockLocation->decodedOffset_);
+        auto end = std::min(offset + length, blockLocation->decodedOffset_ + blockLocation->decodedSize_);
+        if (!consume(decoded.data() + (begin - blockLocation->decodedOffset_), end - begin))
+            return false;
+    }
+    return true;
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_decode_range
+(
+    // decodes bytes [offset, offset + length) of the original data into 'output'
+    std::istream & inStream,
+    std::vector<m99_block_location> const & blockLocations,
+    std::uint64_t offset,
+    std::uint64_t length,
+    std::uint8_t * output,
+    std::size_t numThreads,
+    m99_buffer_pool & bufferPool
+)
+{
+    return m99_decode_range(inStream, blockLocations, offset, length, [&](std::uint8_t const * data, std::size_t size)
+            {
+                output = std::copy(data, data + size, output);
+                return true;
+            }, numThreads, bufferPool);
+}
@@ -0,0 +1,271 @@
+#pragma once
+
+#include "./m99_buffer_pool.h"
+#include <include/endian.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <vector>
+
+
+namespace maniscalco
+{
+
+    // m99 frame (container) format.  all fields are little endian regardless of the host.
+    //
+    //  frame header
+    //  block 0
+    //      block header
+    //      sub block index (the encoded size of each sub block, in sub block order)
+    //      checksums (only if the block has m99_block_flag_checksums): the CRC32C of the encoded data of each sub
+    //          block followed by the CRC32C of the block's original data
+    //      sub block data (in sub block order, each begins at the sum of the sizes before it)
+    //  block 1
+    //  ...
+    //  end of frame (a block header of all zeros)
+    //  block index (for each block the position of its header within the frame and the offset of its original data)
+    //  frame trailer (the position of the block index, the number of blocks and the size of the original data)
+    //
+    // the index precedes the data so a reader can locate every sub block of a block (and skip a whole block)
+    // without decoding anything.  the end of frame marker lets a reader which cannot seek (a pipe) find the end
+    // of the data and distinguish a complete frame from a truncated one.  a reader which can seek reads the
+    // trailer (which is of a fixed size and ends the frame) and then the block index to locate every block
+    // without reading any of the blocks.  positions are relative to the start of the frame.
+    //
+    // a block header is not trusted.  it is checked against the frame's declared maximum block size and against
+    // the length of the input which remains (when that is known) before anything which it claims is allocated.
+
+    static std::uint32_t constexpr m99_frame_magic = 0x4639394d; // "M99F"
+    static std::uint16_t constexpr m99_frame_version = 3;
+
+    // the largest block which a frame may hold
+    static std::uint32_t constexpr m99_max_block_size = (1 << 30);
+
+    // the smallest sub block size which a block may be encoded with.  this bounds the number of sub blocks (and so
+    // the size of the index and the per sub block state) of a block of a given size.
+    static std::uint32_t constexpr m99_min_sub_block_size = (1 << 16);
+
+    struct m99_frame_header
+    {
+        little_endian<std::uint32_t> magic_;
+        little_endian<std::uint16_t> version_;
+        little_endian<std::uint16_t> flags_;    // reserved.  must be zero for this version.
+        little_endian<std::uint32_t> maxBlockSize_; // no block of the frame is larger
+    };
+
+    // codec flags of a block
+    static std::uint16_t constexpr m99_block_flag_adaptive_coding = 0x0001;
+    static std::uint16_t constexpr m99_block_flag_checksums = 0x0002;
+
+    // the deepest split depth which a block may be encoded with
+    static std::uint16_t constexpr m99_max_split_depth = 16;
+
+    struct m99_block_header
+    {
+        little_endian<std::uint32_t> blockSize_;
+        little_endian<std::uint32_t> subBlockSize_;
+        little_endian<std::uint32_t> sentinelIndex_;
+        little_endian<std::uint32_t> subBlockCount_;
+        little_endian<std::uint16_t> flags_;
+        little_endian<std::uint16_t> splitDepth_;
+    };
+
+    struct m99_sub_block_index_entry
+    {
+        little_endian<std::uint32_t> encodedSize_;
+    };
+
+    using m99_checksum = little_endian<std::uint32_t>;
+
+    struct m99_block_index_entry
+    {
+        little_endian<std::uint64_t> position_;
+        little_endian<std::uint64_t> decodedOffset_;
+    };
+
+    static std::uint32_t constexpr m99_frame_trailer_magic = 0x4939394d; // "M99I"
+
+    struct m99_frame_trailer
+    {
+        little_endian<std::uint64_t> indexPosition_;
+        little_endian<std::uint64_t> decodedSize_;
+        little_endian<std::uint32_t> blockCount_;
+        little_endian<std::uint32_t> magic_;
+    };
+
+    static_assert(sizeof(m99_frame_header) == 12);
+    static_assert(sizeof(m99_block_header) == 20);
+    static_assert(sizeof(m99_sub_block_index_entry) == 4);
+    static_assert(sizeof(m99_block_index_entry) == 16);
+    static_assert(sizeof(m99_frame_trailer) == 24);
+
+    // a block read from a frame along with the location of each of its sub blocks within the encoded data
+    struct m99_encoded_block
+    {
+        m99_block_header header_;
+        m99_buffer_pool::buffer_type data_;         // empty if the block is viewed in place (m99_view_block)
+        std::uint8_t const * encodedData_{nullptr}; // data_ or the block's data within the frame in memory
+        std::vector<std::uint64_t> subBlockOffset_; // subBlockCount_ + 1 entries
+        std::vector<std::uint32_t> subBlockChecksum_; // empty unless the block has checksums
+        std::uint32_t checksum_{0};
+    };
+
+    // a block whose sub blocks have been decoded (by m99_decode_sub_blocks) and which awaits the inverse BWT
+    struct m99_decoded_block
+    {
+        m99_block_header header_;
+        m99_buffer_pool::buffer_type bwt_;
+        m99_buffer_pool::buffer_type symbolCounts_;     // per sub block, as required by m99_inverse_bwt
+        bool hasChecksum_{false};
+        std::uint32_t checksum_{0};
+    };
+
+    // the location of a block within a frame and of its decoded data within the original data
+    struct m99_block_location
+    {
+        std::uint64_t position_;        // of the block header within the stream (or the frame if the stream can not seek)
+        std::uint64_t encodedSize_;     // of the whole block (header, index, checksums and data)
+        std::uint64_t decodedOffset_;
+        std::uint32_t decodedSize_;
+    };
+
+    // what the blocks read from a frame may claim.  the maximum block size is taken from the frame header.  the
+    // bytes remaining are those of the input from the next block on (~0 when that is not known, as for a pipe)
+    // and are reduced as each block is read.
+    struct m99_frame_limits
+    {
+        std::uint32_t maxBlockSize_{m99_max_block_size};
+        std::uint64_t bytesRemaining_{~0ull};
+    };
+
+    bool m99_is_valid
+    (
+        m99_frame_header const &
+    );
+
+    bool m99_is_valid
+    (
+        m99_block_header const &
+    );
+
+    bool m99_is_end_of_frame
+    (
+        m99_block_header const &
+    );
+
+    bool m99_read_block
+    (
+        std::istream &,
+        m99_frame_limits &,
+        m99_encoded_block &,
+        m99_buffer_pool &
+    );
+
+    bool m99_view_block
+    (
+        std::uint8_t const * &,
+        std::uint8_t const *,
+        std::uint32_t,
+        m99_encoded_block &
+    );
+
+    bool m99_decode_block
+    (
+        m99_encoded_block const &,
+        std::uint8_t *,
+        std::size_t,
+        m99_buffer_pool &
+    );
+
+    // the two steps of m99_decode_block.  these allow the steps of consecutive blocks to overlap.
+    bool m99_decode_sub_blocks
+    (
+        m99_encoded_block const &,
+        m99_decoded_block &,
+        std::size_t,
+        m99_buffer_pool &
+    );
+
+    bool m99_reverse_block
+    (
+        m99_decoded_block const &,
+        std::uint8_t *,
+        std::size_t,
+        m99_buffer_pool &
+    );
+
+    bool m99_read_block_index
+    (
+        std::istream &,
+        std::vector<m99_block_location> &
+    );
+
+    // receives the decoded range a piece at a time.  returns false to stop.
+    using m99_range_consumer = std::function<bool(std::uint8_t const *, std::size_t)>;
+
+    bool m99_decode_range
+    (
+        std::istream &,
+        std::vector<m99_block_location> const &,
+        std::uint64_t,
+        std::uint64_t,
+        m99_range_consumer const &,
+        std::size_t,
+        m99_buffer_pool &
+    );
+
+    bool m99_decode_range
+    (
+        std::istream &,
+        std::vector<m99_block_location> const &,
+        std::uint64_t,
+        std::uint64_t,
+        std::uint8_t *,
+        std::size_t,
+        m99_buffer_pool &
+    );
+
+} // namespace maniscalco
+
+
+//======================================================================================================================
+inline bool maniscalco::m99_is_valid
+(
+    m99_frame_header const & frameHeader
+)
+{
+    return ((frameHeader.magic_.get() == m99_frame_magic) && (frameHeader.version_.get() == m99_frame_version) &&
+            (frameHeader.flags_.get() == 0) && (frameHeader.maxBlockSize_.get() > 0) && 
+            (frameHeader.maxBlockSize_.get() <= m99_max_block_size));
+}
+
+
+//======================================================================================================================
+inline bool maniscalco::m99_is_valid
+(
+    m99_block_header const & blockHeader
+)
+{
+    // the sub block count must agree with the block and sub block sizes.  the split depth is limited so that a
+    // corrupt header can not ask the decoder for an impossible number of subtrees.
+    std::uint64_t blockSize = blockHeader.blockSize_.get();
+    std::uint64_t subBlockSize = blockHeader.subBlockSize_.get();
+    return ((blockSize > 0) && (blockSize <= m99_max_block_size) && (subBlockSize >= m99_min_sub_block_size) && 
+            (blockHeader.sentinelIndex_.get() <= blockSize) &&
+            (blockHeader.subBlockCount_.get() == ((blockSize + subBlockSize - 1) / subBlockSize)) &&
+            ((blockHeader.flags_.get() & ~(m99_block_flag_adaptive_coding | m99_block_flag_checksums)) == 0) &&
+            (blockHeader.splitDepth_.get() <= m99_max_split_depth));
+}
+
+
+//======================================================================================================================
+inline bool maniscalco::m99_is_end_of_frame
+(
+    m99_block_header const & blockHeader
+)
+{
+    return ((blockHeader.blockSize_.get() == 0) && (blockHeader.subBlockSize_.get() == 0) && (blockHeader.sentinelIndex_.get() == 0) &&
+            (blockHeader.subBlockCount_.get() == 0) && (blockHeader.flags_.get() == 0) && (blockHeader.splitDepth_.get() == 0));
+}
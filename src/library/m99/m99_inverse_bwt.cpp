@@ -0,0 +1,136 @@
+#include "./m99_inverse_bwt.h"
+#include "./m99_thread_pool.h"
+
+#include <algorithm>
+#include <array>
+
+
+namespace
+{
+
+    // the largest block which is reversed by two interleaved walks.  the second walk needs a psi table as large
+    // as the LF table so above this size only the LF table is built (four bytes per symbol rather than eight) and
+    // the block is reversed by a single walk.
+    static auto constexpr max_two_walk_size = (1ull << 24);
+
+
+    //==================================================================================================================
+    maniscalco::m99_buffer_pool & default_buffer_pool
+    (
+        // the pool used by callers which do not give one.  the tables are kept between calls so reversing a stream
+        // of blocks reaches a steady state in which nothing is allocated.
+    )
+    {
+        static maniscalco::m99_buffer_pool bufferPool;
+        return bufferPool;
+    }
+
+} // namespace
+
+
+//======================================================================================================================
+void maniscalco::m99_inverse_bwt
+(
+    // reverses the BWT of a block which was decoded as a sequence of sub blocks of 'subBlockSize' symbols (the last
+    // may be shorter).  'subBlockSymbolCounts' holds the count of each symbol within each sub block (as reported by
+    // m99_decode via m99_decode_options::symbolCounts_) so no counting pass over the block is needed.
+    // [begin, end) is the BWT without the sentinel.  the sentinel belongs at row 'sentinelIndex' and row 0 is the
+    // row which begins with the sentinel.  the original data is written to 'output' which must not overlap the input.
+    std::uint8_t const * begin,
+    std::uint8_t const * end,
+    std::uint32_t sentinelIndex,
+    std::size_t subBlockSize,
+    std::uint32_t const * subBlockSymbolCounts,
+    std::uint8_t * output,
+    std::size_t numThreads
+)
+{
+    m99_inverse_bwt(begin, end, sentinelIndex, subBlockSize, subBlockSymbolCounts, output, numThreads, default_buffer_pool());
+}
+
+
+//======================================================================================================================
+void maniscalco::m99_inverse_bwt
+(
+    std::uint8_t const * begin,
+    std::uint8_t const * end,
+    std::uint32_t sentinelIndex,
+    std::size_t subBlockSize,
+    std::uint32_t const * subBlockSymbolCounts,
+    std::uint8_t * output,
+    std::size_t numThreads,
+    m99_buffer_pool & bufferPool
+)
+{
+    static auto constexpr alphabet_size = m99_inverse_bwt_alphabet_size;
+    std::size_t size = std::distance(begin, end);
+    if (size == 0)
+        return;
+    std::size_t numSubBlocks = ((size + subBlockSize - 1) / subBlockSize);
+
+    // the first row for each symbol within each sub block.  row 0 is the sentinel row so rows start at 1.
+    using first_row_type = std::array<std::uint32_t, alphabet_size>;
+    auto firstRowBuffer = bufferPool.acquire(numSubBlocks * sizeof(first_row_type));
+    auto firstRow = (first_row_type *)firstRowBuffer.data();
+    std::uint32_t row = 1;
+    for (auto symbol = 0; symbol < alphabet_size; ++symbol)
+        for (std::size_t subBlock = 0; subBlock < numSubBlocks; ++subBlock)
+        {
+            firstRow[subBlock][symbol] = row;
+            row += subBlockSymbolCounts[(subBlock * alphabet_size) + symbol];
+        }
+
+    // build the LF mapping and (for a block small enough to walk twice) its inverse (psi).  each sub block knows
+    // where its rows begin so the sub blocks are independent and are built in parallel.
+    auto twoWalks = (size <= max_two_walk_size);
+    auto lfBuffer = bufferPool.acquire((size + 1) * sizeof(std::uint32_t));
+    auto psiBuffer = twoWalks ? bufferPool.acquire((size + 1) * sizeof(std::uint32_t)) : m99_buffer_pool::buffer_type();
+    auto lf = (std::uint32_t *)lfBuffer.data();
+    auto psi = (std::uint32_t *)psiBuffer.data();
+    lf[sentinelIndex] = 0;
+    if (twoWalks)
+        psi[0] = sentinelIndex;
+    m99_thread_pool::instance().parallel_for(numSubBlocks, numThreads, [&](std::size_t subBlock)
+            {
+                auto nextRow = firstRow[subBlock];
+                auto subBlockBegin = (subBlock * subBlockSize);
+                auto subBlockEnd = std::min(subBlockBegin + subBlockSize, size);
+                for (auto i = subBlockBegin; i < subBlockEnd; ++i)
+                {
+                    std::uint32_t row = (i + (i >= sentinelIndex));
+                    auto lfRow = nextRow[begin[i]]++;
+                    lf[row] = lfRow;
+                    if (twoWalks)
+                        psi[lfRow] = row;
+                }
+            });
+
+    auto symbol_at = [&](std::uint32_t row){return begin[row - (row > sentinelIndex)];};
+    std::uint32_t backwardRow = 0;
+    auto backwardOutput = (output + size);
+    if (!twoWalks)
+    {
+        // a single LF walk backward from row 0 produces the whole of the data
+        while (backwardOutput != output)
+        {
+            *--backwardOutput = symbol_at(backwardRow);
+            backwardRow = lf[backwardRow];
+        }
+        return;
+    }
+
+    // two independent walks which are interleaved so that their cache misses overlap.  psi walks forward
+    // from the sentinel row (the whole of the data) to produce the first half and LF walks backward from
+    // row 0 to produce the second half.
+    std::uint32_t forwardRow = sentinelIndex;
+    auto forwardOutput = output;
+    for (std::size_t i = 0; i < (size >> 1); ++i)
+    {
+        forwardRow = psi[forwardRow];
+        *forwardOutput++ = symbol_at(forwardRow);
+        *--backwardOutput = symbol_at(backwardRow);
+        backwardRow = lf[backwardRow];
+    }
+    if (size & 1)
+        *--backwardOutput = symbol_at(backwardRow);
+}
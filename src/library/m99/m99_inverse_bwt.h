@@ -0,0 +1,40 @@
+#pragma once
+
+#include "./m99_buffer_pool.h"
+
+#include <cstdint>
+#include <cstddef>
+
+
+namespace maniscalco
+{
+
+    // number of symbol counts per sub block expected by m99_inverse_bwt
+    static auto constexpr m99_inverse_bwt_alphabet_size = 256;
+
+    // the tables are taken from a pool which is shared by the whole process
+    void m99_inverse_bwt
+    (
+        std::uint8_t const *,
+        std::uint8_t const *,
+        std::uint32_t,
+        std::size_t,
+        std::uint32_t const *,
+        std::uint8_t *,
+        std::size_t
+    );
+
+    // as above but the tables are taken from (and returned to) the given pool
+    void m99_inverse_bwt
+    (
+        std::uint8_t const *,
+        std::uint8_t const *,
+        std::uint32_t,
+        std::size_t,
+        std::uint32_t const *,
+        std::uint8_t *,
+        std::size_t,
+        m99_buffer_pool &
+    );
+
+} // namespace maniscalco
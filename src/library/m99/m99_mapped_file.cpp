@@ -0,0 +1,197 @@
+#include "./m99_mapped_file.h"
+
+#if defined(__linux__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+
+#if defined(__linux__)
+namespace
+{
+
+    //==================================================================================================================
+    std::size_t page_size
+    (
+        // the system's page size.  this is not always 4KB (some arm64 and ppc64 kernels use 16KB or 64KB pages)
+    )
+    {
+        static std::size_t const pageSize = ::sysconf(_SC_PAGESIZE);
+        return pageSize;
+    }
+
+} // namespace
+#endif
+
+
+//======================================================================================================================
+maniscalco::m99_mapped_file::~m99_mapped_file
+(
+)
+{
+    close();
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_mapped_file::open
+(
+    // maps the whole of an existing file.  returns false if the file can not be opened or mapped.
+    char const * path,
+    access_type access
+)
+{
+    close();
+    #if defined(__linux__)
+        fileDescriptor_ = ::open(path, (access == access_type::read_write) ? O_RDWR : O_RDONLY);
+        if (fileDescriptor_ < 0)
+            return false;
+        struct stat fileStatus;
+        if ((::fstat(fileDescriptor_, &fileStatus) != 0) || (!S_ISREG(fileStatus.st_mode)))
+        {
+            close();
+            return false;
+        }
+        size_ = fileStatus.st_size;
+        return map(access);
+    #else
+        (void)path;
+        (void)access;
+        return false;
+    #endif
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_mapped_file::create
+(
+    // creates (or truncates) a file of 'size' bytes and maps it for writing.  the disk space is allocated up front
+    // because running out of space while writing to a mapping is only reported by a signal.
+    char const * path,
+    std::size_t size
+)
+{
+    close();
+    #if defined(__linux__)
+        fileDescriptor_ = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+        if (fileDescriptor_ < 0)
+            return false;
+        size_ = size;
+        if ((size_ > 0) && ((::ftruncate(fileDescriptor_, size_) != 0) || (::posix_fallocate(fileDescriptor_, 0, size_) != 0)))
+        {
+            close();
+            return false;
+        }
+        return map(access_type::read_write);
+    #else
+        (void)path;
+        (void)size;
+        return false;
+    #endif
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_mapped_file::map
+(
+    access_type access
+)
+{
+    #if defined(__linux__)
+        // an empty file can not be mapped but is trivially 'mapped' by a null range
+        if (size_ == 0)
+            return true;
+        auto protection = (access == access_type::read_only) ? PROT_READ : (PROT_READ | PROT_WRITE);
+        auto flags = (access == access_type::read_write) ? MAP_SHARED : MAP_PRIVATE;
+        auto data = ::mmap(nullptr, size_, protection, flags, fileDescriptor_, 0);
+        if (data == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+        data_ = (std::uint8_t *)data;
+        return true;
+    #else
+        (void)access;
+        return false;
+    #endif
+}
+
+
+//======================================================================================================================
+void maniscalco::m99_mapped_file::close
+(
+)
+{
+    #if defined(__linux__)
+        if (data_ != nullptr)
+            ::munmap(data_, size_);
+        if (fileDescriptor_ >= 0)
+            ::close(fileDescriptor_);
+    #endif
+    fileDescriptor_ = -1;
+    data_ = nullptr;
+    size_ = 0;
+}
+
+
+//======================================================================================================================
+std::uint8_t * maniscalco::m99_mapped_file::data
+(
+) const
+{
+    return data_;
+}
+
+
+//======================================================================================================================
+std::size_t maniscalco::m99_mapped_file::size
+(
+) const
+{
+    return size_;
+}
+
+
+//======================================================================================================================
+void maniscalco::m99_mapped_file::advise_sequential
+(
+    // the mapping will be accessed mostly in order so the kernel can read ahead aggressively and drop pages
+    // soon after they are used
+)
+{
+    #if defined(__linux__)
+        if (data_ != nullptr)
+            ::madvise(data_, size_, MADV_SEQUENTIAL);
+    #endif
+}
+
+
+//======================================================================================================================
+void maniscalco::m99_mapped_file::discard
+(
+    // the range [offset, offset + size) is no longer needed.  for a copy on write mapping this frees the private
+    // copies of any pages which were written (they revert to the file's contents).  only the pages which lie
+    // entirely within the range (or which end the file) are discarded so neighbouring data which shares a page
+    // is never lost.
+    std::size_t offset,
+    std::size_t size
+)
+{
+    #if defined(__linux__)
+        if ((data_ == nullptr) || (offset >= size_))
+            return;
+        auto end = (size > (size_ - offset)) ? size_ : (offset + size);
+        auto pageSize = page_size();
+        if (end < size_)
+            end &= ~(pageSize - 1);
+        offset = ((offset + pageSize - 1) & ~(pageSize - 1));
+        if (offset < end)
+            ::madvise(data_ + offset, end - offset, MADV_DONTNEED);
+    #else
+        (void)offset;
+        (void)size;
+    #endif
+}
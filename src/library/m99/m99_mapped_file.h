@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+
+namespace maniscalco
+{
+
+    // a whole file mapped into memory (linux only.  elsewhere open and create fail so callers fall back to
+    // streams).  reading from a mapping avoids copying the data from the page cache into a buffer and writing to
+    // a mapping lets the data be produced in place rather than copied out of a buffer by a write.
+    class m99_mapped_file
+    {
+    public:
+
+        enum class access_type
+        {
+            read_only,
+            copy_on_write,  // writable but changes are private to the process and never reach the file
+            read_write
+        };
+
+        m99_mapped_file() = default;
+
+        m99_mapped_file(m99_mapped_file const &) = delete;
+
+        m99_mapped_file & operator = (m99_mapped_file const &) = delete;
+
+        ~m99_mapped_file();
+
+        bool open
+        (
+            char const *,
+            access_type
+        );
+
+        bool create
+        (
+            char const *,
+            std::size_t
+        );
+
+        void close();
+
+        std::uint8_t * data() const;
+
+        std::size_t size() const;
+
+        void advise_sequential();
+
+        void discard
+        (
+            std::size_t,
+            std::size_t
+        );
+
+    private:
+
+        bool map
+        (
+            access_type
+        );
+
+        int fileDescriptor_{-1};
+
+        std::uint8_t * data_{nullptr};
+
+        std::size_t size_{0};
+    };
+
+} // namespace maniscalco
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+
+#if defined(__AVX2__) || defined(__AVX512BW__)
+    #include <immintrin.h>
+#endif
+
+
+namespace maniscalco
+{
+
+    template <typename symbol_type>
+    std::size_t m99_run_length
+    (
+        symbol_type const *,
+        symbol_type const *
+    );
+
+    template <typename symbol_type>
+    void m99_run_fill
+    (
+        symbol_type *,
+        std::size_t,
+        symbol_type
+    );
+
+} // namespace maniscalco
+
+
+//=============================================================================
+template <typename symbol_type>
+inline std::size_t maniscalco::m99_run_length
+(
+    // returns the length of the run of the symbol at 'begin' within [begin, end).
+    // compares 64, 32 or 8 bytes at a time depending on the instruction set available.
+    // the comparison is byte wise against the repeated symbol so the first mismatching
+    // byte identifies the first mismatching symbol for any symbol size.
+    symbol_type const * begin,
+    symbol_type const * end
+)
+{
+    static_assert((sizeof(symbol_type) == 1) || (sizeof(symbol_type) == 2) || (sizeof(symbol_type) == 4));
+    if (begin >= end)
+        return 0;
+    auto symbol = *begin;
+    auto cur = (std::uint8_t const *)begin;
+    auto last = (std::uint8_t const *)end;
+    auto run_length = [&](std::uint8_t const * mismatch)
+            {
+                return ((std::size_t)std::distance((std::uint8_t const *)begin, mismatch) / sizeof(symbol_type));
+            };
+
+    #if defined(__AVX512BW__)
+    {
+        auto pattern = (sizeof(symbol_type) == 1) ? _mm512_set1_epi8(symbol) :
+                (sizeof(symbol_type) == 2) ? _mm512_set1_epi16(symbol) : _mm512_set1_epi32(symbol);
+        for (; std::distance(cur, last) >= 64; cur += 64)
+        {
+            std::uint64_t mismatch = _mm512_cmpneq_epi8_mask(_mm512_loadu_si512(cur), pattern);
+            if (mismatch != 0)
+                return run_length(cur + __builtin_ctzll(mismatch));
+        }
+    }
+    #endif
+
+    #if defined(__AVX2__)
+    {
+        auto pattern = (sizeof(symbol_type) == 1) ? _mm256_set1_epi8(symbol) :
+                (sizeof(symbol_type) == 2) ? _mm256_set1_epi16(symbol) : _mm256_set1_epi32(symbol);
+        for (; std::distance(cur, last) >= 32; cur += 32)
+        {
+            std::uint32_t mismatch = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                    _mm256_loadu_si256((__m256i const *)cur), pattern));
+            if (mismatch != 0)
+                return run_length(cur + __builtin_ctz(mismatch));
+        }
+    }
+    #endif
+
+    // eight bytes at a time (little endian so the first mismatching byte is the lowest non zero byte)
+    static auto constexpr broadcast = (0xffffffffffffffffull / ((1ull << (sizeof(symbol_type) * 8)) - 1));
+    auto pattern = (symbol * broadcast);
+    for (; std::distance(cur, last) >= 8; cur += 8)
+    {
+        std::uint64_t bytes;
+        std::memcpy(&bytes, cur, sizeof(bytes));
+        if (auto mismatch = (bytes ^ pattern); mismatch != 0)
+            return run_length(cur + (__builtin_ctzll(mismatch) >> 3));
+    }
+    auto current = (symbol_type const *)cur;
+    while ((current < end) && (*current == symbol))
+        ++current;
+    return std::distance(begin, current);
+}
+
+
+//=============================================================================
+template <typename symbol_type>
+inline void maniscalco::m99_run_fill
+(
+    symbol_type * destination,
+    std::size_t size,
+    symbol_type symbol
+)
+{
+    // memset is already vectorized (and uses non temporal stores for very large runs)
+    if constexpr (sizeof(symbol_type) == 1)
+        std::memset(destination, symbol, size);
+    else
+        std::fill_n(destination, size, symbol);
+}
@@ -0,0 +1,175 @@
+#include "./m99_thread_pool.h"
+
+#include <iterator>
+
+
+namespace
+{
+
+    // the pool and queue of the current thread if it is a worker.  a worker queues the tasks it submits on its own
+    // queue so that nested work stays with the thread which created it unless another thread is idle.
+    thread_local maniscalco::m99_thread_pool const * currentPool = nullptr;
+    thread_local std::size_t currentQueue = 0;
+
+} // namespace
+
+
+//======================================================================================================================
+maniscalco::m99_thread_pool::m99_thread_pool
+(
+    std::size_t numWorkers
+)
+{
+    numWorkers = std::max<std::size_t>(numWorkers, 1);
+    for (std::size_t i = 0; i < numWorkers; ++i)
+        queues_.push_back(std::make_unique<queue_type>());
+    for (std::size_t i = 0; i < numWorkers; ++i)
+        workers_.emplace_back([this, i](){run_worker(i);});
+}
+
+
+//======================================================================================================================
+maniscalco::m99_thread_pool::~m99_thread_pool
+(
+)
+{
+    {
+        std::lock_guard lockGuard(sleepMutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto & worker : workers_)
+        worker.join();
+}
+
+
+//======================================================================================================================
+auto maniscalco::m99_thread_pool::instance
+(
+) -> m99_thread_pool &
+{
+    static m99_thread_pool threadPool(std::max<std::size_t>(std::thread::hardware_concurrency(), 2) - 1);
+    return threadPool;
+}
+
+
+//======================================================================================================================
+std::size_t maniscalco::m99_thread_pool::size
+(
+) const
+{
+    return workers_.size();
+}
+
+
+//======================================================================================================================
+void maniscalco::m99_thread_pool::submit
+(
+    task_type task
+)
+{
+    auto index = (currentPool == this) ? currentQueue : (nextQueue_++ % queues_.size());
+    {
+        auto & queue = *queues_[index];
+        std::lock_guard lockGuard(queue.mutex_);
+        ++task.group_->queued_;
+        queue.tasks_.push_back(std::move(task));
+        ++numQueued_;
+    }
+    // the sleep mutex orders this with a sleeper's check of numQueued_ so the wake up is not lost.  only idle
+    // workers sleep on 'wake_' so the one woken is free to take the task.  (threads waiting for a group sleep on
+    // 'groupWake_' instead.  a group's tasks are all queued before its owner waits so they need no wake up here.)
+    {
+        std::lock_guard lockGuard(sleepMutex_);
+    }
+    wake_.notify_one();
+}
+
+
+//======================================================================================================================
+bool maniscalco::m99_thread_pool::run_one
+(
+    // runs one queued task if there is one.  a worker takes the newest task of its own queue (whose data is most
+    // likely still in cache) and otherwise steals the oldest task of another queue (the largest piece of work).
+    // a thread which is waiting for 'group' runs only the tasks of that group.  the waiting thread is part way
+    // through some work of its own (which may hold per thread state) so it must not start unrelated work.
+    group_type * group
+)
+{
+    if ((group == nullptr) ? (numQueued_ == 0) : (group->queued_ == 0))
+        return false;
+    auto first = (currentPool == this) ? currentQueue : 0;
+    for (std::size_t i = 0; i < queues_.size(); ++i)
+    {
+        auto & queue = *queues_[(first + i) % queues_.size()];
+        std::unique_lock uniqueLock(queue.mutex_);
+        auto & tasks = queue.tasks_;
+        auto own = ((i == 0) && (currentPool == this));
+        auto matches = [&](task_type const & task){return ((group == nullptr) || (task.group_ == group));};
+        auto iter = tasks.end();
+        if (own)
+        {
+            auto reverseIter = std::find_if(tasks.rbegin(), tasks.rend(), matches);
+            if (reverseIter != tasks.rend())
+                iter = std::prev(reverseIter.base());
+        }
+        else
+        {
+            iter = std::find_if(tasks.begin(), tasks.end(), matches);
+        }
+        if (iter == tasks.end())
+            continue;
+        auto task = std::move(*iter);
+        tasks.erase(iter);
+        --task.group_->queued_;
+        --numQueued_;
+        uniqueLock.unlock();
+
+        task.function_();
+        if (--task.group_->pending_ == 0)
+        {
+            // the owner of the group may be asleep waiting for it
+            std::lock_guard lockGuard(sleepMutex_);
+            groupWake_.notify_all();
+        }
+        return true;
+    }
+    return false;
+}
+
+
+//======================================================================================================================
+void maniscalco::m99_thread_pool::wait
+(
+    // helps with the tasks of 'group' until every one of them has completed
+    group_type & group
+)
+{
+    while (group.pending_ > 0)
+    {
+        if (run_one(&group))
+            continue;
+        std::unique_lock uniqueLock(sleepMutex_);
+        groupWake_.wait(uniqueLock, [&](){return ((group.pending_ == 0) || (group.queued_ > 0));});
+    }
+}
+
+
+//======================================================================================================================
+void maniscalco::m99_thread_pool::run_worker
+(
+    std::size_t index
+)
+{
+    currentPool = this;
+    currentQueue = index;
+    while (true)
+    {
+        if (run_one(nullptr))
+            continue;
+        std::unique_lock uniqueLock(sleepMutex_);
+        wake_.wait(uniqueLock, [&](){return (stop_ || (numQueued_ > 0));});
+        if (stop_ && (numQueued_ == 0))
+            return;
+    }
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace maniscalco
+{
+
+    // persistent pool of worker threads shared by all of the library's parallel work (sub blocks, subtrees, the
+    // inverse BWT and whole blocks) so that no threads are created per block.  each worker has its own queue and
+    // takes the most recent of its own tasks first while idle workers steal the oldest tasks of others.  a thread
+    // which waits for its tasks runs those of them which have not yet started so the caller takes part and parallel
+    // work may be nested (a task may itself wait for tasks) without deadlock.
+    class m99_thread_pool
+    {
+    public:
+
+        m99_thread_pool
+        (
+            std::size_t
+        );
+
+        m99_thread_pool(m99_thread_pool const &) = delete;
+
+        m99_thread_pool & operator = (m99_thread_pool const &) = delete;
+
+        ~m99_thread_pool();
+
+        // the pool used by the library.  it has a worker for each hardware thread beyond the first (the caller is
+        // the remaining thread).
+        static m99_thread_pool & instance();
+
+        std::size_t size() const;
+
+        template <typename function_type>
+        void parallel_for
+        (
+            std::size_t,
+            std::size_t,
+            function_type
+        );
+
+    private:
+
+        struct group_type
+        {
+            std::atomic<std::size_t> pending_{0};   // not yet complete
+            std::atomic<std::size_t> queued_{0};    // not yet started
+        };
+
+        struct task_type
+        {
+            std::function<void()> function_;
+            group_type * group_;
+        };
+
+        struct queue_type
+        {
+            std::mutex mutex_;
+            std::deque<task_type> tasks_;
+        };
+
+        void submit
+        (
+            task_type
+        );
+
+        void wait
+        (
+            group_type &
+        );
+
+        bool run_one
+        (
+            group_type *
+        );
+
+        void run_worker
+        (
+            std::size_t
+        );
+
+        std::vector<std::unique_ptr<queue_type>> queues_;
+
+        std::vector<std::thread> workers_;
+
+        std::atomic<std::size_t> numQueued_{0};
+
+        std::atomic<std::size_t> nextQueue_{0};
+
+        std::mutex sleepMutex_;
+
+        std::condition_variable wake_;          // idle workers
+
+        std::condition_variable groupWake_;     // threads waiting for a group
+
+        bool stop_{false};
+    };
+
+} // namespace maniscalco
+
+
+//======================================================================================================================
+template <typename function_type>
+void maniscalco::m99_thread_pool::parallel_for
+(
+    // calls function(index) for every index in [0, count) and returns once all have returned.  at most
+    // 'maxConcurrency' threads (including the caller) work on the range at once.  each claims the next index
+    // as it finishes the last so uneven work balances itself.
+    std::size_t count,
+    std::size_t maxConcurrency,
+    function_type function
+)
+{
+    auto numHelpers = (std::min({count, std::max<std::size_t>(maxConcurrency, 1), size() + 1}) - 1);
+    if (numHelpers == 0)
+    {
+        for (std::size_t index = 0; index < count; ++index)
+            function(index);
+        return;
+    }
+
+    std::atomic<std::size_t> nextIndex{0};
+    auto work = [&]()
+            {
+                for (auto index = nextIndex++; index < count; index = nextIndex++)
+                    function(index);
+            };
+    group_type group;
+    group.pending_ = numHelpers;
+    for (std::size_t i = 0; i < numHelpers; ++i)
+        submit({work, &group});
+    work();
+    wait(group);
+}
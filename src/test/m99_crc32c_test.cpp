@@ -0,0 +1,68 @@
+#include <library/m99/m99_crc32c.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+
+namespace
+{
+
+    //==================================================================================================================
+    bool test_check_value
+    (
+        // the standard check value of CRC32C is that of the nine bytes "123456789"
+    )
+    {
+        static char constexpr check_input[] = "123456789";
+        auto crc = maniscalco::m99_crc32c(check_input, std::strlen(check_input));
+        if (crc != 0xe3069283)
+        {
+            std::cerr << "check value: " << std::hex << crc << ", expected e3069283\n";
+            return false;
+        }
+        return true;
+    }
+
+
+    //==================================================================================================================
+    bool test_incremental
+    (
+        // a checksum computed in pieces (of every alignment) must equal the checksum of the whole
+    )
+    {
+        std::vector<std::uint8_t> input(1000);
+        for (std::size_t i = 0; i < input.size(); ++i)
+            input[i] = (std::uint8_t)((i * 131) + (i >> 3));
+        auto expected = maniscalco::m99_crc32c(input.data(), input.size());
+        for (std::size_t split = 0; split <= 17; ++split)
+        {
+            auto crc = maniscalco::m99_crc32c(input.data(), split);
+            crc = maniscalco::m99_crc32c(input.data() + split, input.size() - split, crc);
+            if (crc != expected)
+            {
+                std::cerr << "incremental: split at " << split << " gave a different checksum\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+} // namespace
+
+
+//======================================================================================================================
+int main
+(
+    int,
+    char const **
+)
+{
+    if (!test_check_value())
+        return 1;
+    if (!test_incremental())
+        return 1;
+    std::cout << "m99_crc32c_test passed\n";
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <library/m99/m99_encode.h>
+#include <library/m99/m99_decode.h>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+
+namespace
+{
+
+    //==================================================================================================================
+    bool test_no_start_marker
+    (
+        // a stream which is all zeros has no start of stream marker and must be rejected rather than decoded
+    )
+    {
+        std::vector<std::uint8_t> encoded(16, 0);
+        maniscalco::m99_decode_stream decodeStream(encoded.data(), encoded.data() + encoded.size());
+        std::vector<std::uint8_t> decoded(100);
+        if (maniscalco::m99_decode(decodeStream, decoded.data(), decoded.data() + decoded.size()))
+        {
+            std::cerr << "no start marker: a stream of zeros was accepted\n";
+            return false;
+        }
+        return true;
+    }
+
+
+
+    //==================================================================================================================
+    bool test_zero_symbol_count
+    (
+        // a start marker followed by zeros gives a header whose first symbol count is zero.  that must be rejected
+        // rather than read as an endless list of symbols.
+    )
+    {
+        std::vector<std::uint8_t> encoded(16, 0);
+        encoded[0] = 0x80;
+        maniscalco::m99_decode_stream decodeStream(encoded.data(), encoded.data() + encoded.size());
+        std::vector<std::uint8_t> decoded(100);
+        if (maniscalco::m99_decode(decodeStream, decoded.data(), decoded.data() + decoded.size()))
+        {
+            std::cerr << "zero symbol count: the stream was accepted\n";
+            return false;
+        }
+        return true;
+    }
+
+
+
+    //==================================================================================================================
+    bool test_stream_not_consumed
+    (
+        // a valid stream decodes.  the same stream with a byte appended leaves bits unconsumed and must be rejected.
+    )
+    {
+        std::vector<std::uint8_t> input(4096);
+        for (std::size_t i = 0; i < input.size(); ++i)
+            input[i] = "abracadabra"[i % 11];
+        std::vector<std::uint8_t> region(maniscalco::m99_encode_bound<std::uint8_t>(input.size()));
+        maniscalco::m99_encode_stream encodeStream(region.data(), region.data() + region.size());
+        maniscalco::m99_encode(input.data(), input.data() + input.size(), encodeStream);
+        encodeStream.flush();
+        std::vector<std::uint8_t> encoded(encodeStream.data(), encodeStream.data() + ((encodeStream.size() + 7) / 8));
+
+        std::vector<std::uint8_t> decoded(input.size());
+        maniscalco::m99_decode_stream decodeStream(encoded.data(), encoded.data() + encoded.size());
+        if ((!maniscalco::m99_decode(decodeStream, decoded.data(), decoded.data() + decoded.size())) || (decoded != input))
+        {
+            std::cerr << "stream not consumed: a valid stream was not decoded\n";
+            return false;
+        }
+
+        encoded.push_back(0x5a);
+        maniscalco::m99_decode_stream longStream(encoded.data(), encoded.data() + encoded.size());
+        if (maniscalco::m99_decode(longStream, decoded.data(), decoded.data() + decoded.size()))
+        {
+            std::cerr << "stream not consumed: a stream with trailing bytes was accepted\n";
+            return false;
+        }
+        return true;
+    }
+
+} // namespace
+
+
+//======================================================================================================================
+int main
+(
+    int,
+    char const **
+)
+{
+    if (!test_no_start_marker())
+        return 1;
+    if (!test_zero_symbol_count())
+        return 1;
+    if (!test_stream_not_consumed())
+        return 1;
+    std::cout << "m99_decode_test passed\n";
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include <library/m99/m99_encode.h>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+
+namespace
+{
+
+    //==================================================================================================================
+    template <typename symbol_type>
+    std::vector<symbol_type> make_input
+    (
+        // deterministic input of 'size' symbols drawn from 'alphabetSize' distinct values.  runs of repeated
+        // symbols are mixed in so that both the merge and its leading run shortcut are exercised.
+        std::size_t size,
+        std::uint32_t alphabetSize
+    )
+    {
+        std::vector<symbol_type> input(size);
+        std::uint32_t state = 12345;
+        for (std::size_t i = 0; i < size; )
+        {
+            state = ((state * 1103515245) + 12345);
+            auto symbol = (symbol_type)((state >> 8) % alphabetSize);
+            auto runLength = (((state >> 28) == 0) ? ((state >> 20) & 0xff) : 1);
+            for (std::size_t j = 0; (j < runLength) && (i < size); ++j)
+                input[i++] = symbol;
+        }
+        return input;
+    }
+
+
+    //==================================================================================================================
+    template <typename symbol_type>
+    std::vector<std::uint8_t> encode
+    (
+        std::vector<symbol_type> const & input,
+        maniscalco::m99_encode_options const & options,
+        std::size_t & bits
+    )
+    {
+        std::vector<std::uint8_t> region(maniscalco::m99_encode_bound<symbol_type>(input.size(), options));
+        maniscalco::m99_encode_stream encodeStream(region.data(), region.data() + region.size());
+        maniscalco::m99_encode(input.data(), input.data() + input.size(), encodeStream, options);
+        bits = encodeStream.size();
+        encodeStream.flush();
+        return std::vector<std::uint8_t>(encodeStream.data(), encodeStream.data() + ((bits + 7) / 8));
+    }
+
+
+    //==================================================================================================================
+    template <typename symbol_type>
+    bool test_encoded_size
+    (
+        // m99_encoded_size must give exactly the number of bits which m99_encode produces
+        std::size_t size,
+        std::uint32_t alphabetSize
+    )
+    {
+        auto input = make_input<symbol_type>(size, alphabetSize);
+        std::size_t bits = 0;
+        encode(input, {}, bits);
+        auto encodedSize = maniscalco::m99_encoded_size(input.data(), input.data() + input.size());
+        if (encodedSize != bits)
+        {
+            std::cerr << "encoded size: " << encodedSize << " bits for " << size << " symbols of width " <<
+                    sizeof(symbol_type) << ", expected " << bits << '\n';
+            return false;
+        }
+        return true;
+    }
+
+
+    //==================================================================================================================
+    bool test_thread_count_independent
+    (
+        // the encoding must not depend on the number of threads which produce it
+    )
+    {
+        auto input = make_input<std::uint8_t>(1 << 20, 64);
+        for (std::uint32_t splitDepth : {0, 4})
+        {
+            std::size_t bits = 0;
+            auto expected = encode(input, {.numThreads_ = 1, .splitDepth_ = splitDepth}, bits);
+            for (std::size_t numThreads : {2, 3, 8})
+            {
+                if (encode(input, {.numThreads_ = numThreads, .splitDepth_ = splitDepth}, bits) != expected)
+                {
+                    std::cerr << "thread count independent: " << numThreads << " threads (split depth " << splitDepth <<
+                            ") gave a different encoding than one thread\n";
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+} // namespace
+
+
+//======================================================================================================================
+int main
+(
+    int,
+    char const **
+)
+{
+    for (std::size_t size : {1, 2, 3, 1000, 65536, 100003})
+    {
+        if (!test_encoded_size<std::uint8_t>(size, 1) || !test_encoded_size<std::uint8_t>(size, 4) ||
+                !test_encoded_size<std::uint8_t>(size, 256))
+            return 1;
+        if (!test_encoded_size<std::uint16_t>(size, 3000) || !test_encoded_size<std::uint32_t>(size, 100000))
+            return 1;
+    }
+    if (!test_thread_count_independent())
+        return 1;
+    std::cout << "m99_encode_test passed\n";
+    return 0;
+}
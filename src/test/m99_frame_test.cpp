@@ -0,0 +1,306 @@
+#include <library/m99/m99_buffer_pool.h>
+#include <library/m99/m99_crc32c.h>
+#include <library/m99/m99_encode.h>
+#include <library/m99/m99_frame.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+
+    static std::size_t constexpr input_size = 400000;
+    static std::uint32_t constexpr block_size = 150000;
+    static std::uint32_t constexpr sub_block_size = maniscalco::m99_min_sub_block_size;
+    static std::size_t constexpr num_threads = 2;
+
+
+    //==================================================================================================================
+    std::vector<std::uint8_t> make_input
+    (
+        // deterministic input with little repetition so that the naive BWT below is quick
+    )
+    {
+        std::vector<std::uint8_t> input(input_size);
+        std::uint32_t state = 12345;
+        for (auto & symbol : input)
+        {
+            state = ((state * 1103515245) + 12345);
+            symbol = (std::uint8_t)('a' + ((state >> 16) & 0x0f));
+        }
+        return input;
+    }
+
+
+    //==================================================================================================================
+    std::uint32_t forward_bwt
+    (
+        // the BWT of [begin, end) as m99_inverse_bwt expects it (the BWT without the sentinel).  returns the row of
+        // the sentinel.  the suffixes are sorted by direct comparison which is fine for the input above.
+        std::uint8_t const * begin,
+        std::uint8_t const * end,
+        std::uint8_t * output
+    )
+    {
+        std::size_t size = std::distance(begin, end);
+        std::vector<std::uint32_t> suffixes(size);
+        std::iota(suffixes.begin(), suffixes.end(), 0);
+        std::sort(suffixes.begin(), suffixes.end(), [&](auto a, auto b)
+                {
+                    // the sentinel sorts first so a suffix which is a prefix of another precedes it
+                    auto result = std::memcmp(begin + a, begin + b, size - std::max(a, b));
+                    return ((result != 0) ? (result < 0) : (a > b));
+                });
+        // row 0 is the sentinel's suffix which is preceded by the last symbol
+        std::uint32_t sentinelIndex = 0;
+        *output++ = begin[size - 1];
+        for (std::size_t row = 1; row <= size; ++row)
+        {
+            auto suffix = suffixes[row - 1];
+            if (suffix == 0)
+                sentinelIndex = row;
+            else
+                *output++ = begin[suffix - 1];
+        }
+        return sentinelIndex;
+    }
+
+
+    //==================================================================================================================
+    void append
+    (
+        std::string & frame,
+        void const * data,
+        std::size_t size
+    )
+    {
+        frame.append((char const *)data, size);
+    }
+
+
+    //==================================================================================================================
+    std::string make_frame
+    (
+        // a frame holding 'input' as the m99 encoder writes it: checksummed blocks followed by the end of frame
+        // marker, the block index and the trailer
+        std::vector<std::uint8_t> const & input
+    )
+    {
+        std::string frame;
+        maniscalco::m99_frame_header frameHeader
+        {
+            .magic_ = maniscalco::m99_frame_magic,
+            .version_ = maniscalco::m99_frame_version,
+            .flags_ = 0,
+            .maxBlockSize_ = block_size
+        };
+        append(frame, &frameHeader, sizeof(frameHeader));
+
+        std::vector<maniscalco::m99_block_index_entry> blockIndex;
+        for (std::size_t blockOffset = 0; blockOffset < input.size(); blockOffset += block_size)
+        {
+            auto blockBegin = (input.data() + blockOffset);
+            std::uint32_t blockSize = std::min<std::size_t>(block_size, input.size() - blockOffset);
+            std::vector<std::uint8_t> bwt(blockSize);
+            auto sentinelIndex = forward_bwt(blockBegin, blockBegin + blockSize, bwt.data());
+
+            std::vector<std::string> subBlocks;
+            for (std::size_t subBlockOffset = 0; subBlockOffset < blockSize; subBlockOffset += sub_block_size)
+            {
+                auto subBlockBegin = (bwt.data() + subBlockOffset);
+                auto subBlockEnd = (bwt.data() + std::min<std::size_t>(subBlockOffset + sub_block_size, blockSize));
+                std::vector<std::uint8_t> region(maniscalco::m99_encode_bound(std::distance(subBlockBegin, subBlockEnd)));
+                maniscalco::m99_encode_stream encodeStream(region.data(), region.data() + region.size());
+                maniscalco::m99_encode(subBlockBegin, subBlockEnd, encodeStream);
+                encodeStream.flush();
+                subBlocks.emplace_back((char const *)encodeStream.data(), (encodeStream.size() + 7) / 8);
+            }
+
+            blockIndex.push_back({.position_ = frame.size(), .decodedOffset_ = blockOffset});
+            maniscalco::m99_block_header blockHeader
+            {
+                .blockSize_ = blockSize,
+                .subBlockSize_ = sub_block_size,
+                .sentinelIndex_ = sentinelIndex,
+                .subBlockCount_ = (std::uint32_t)subBlocks.size(),
+                .flags_ = maniscalco::m99_block_flag_checksums,
+                .splitDepth_ = 0
+            };
+            append(frame, &blockHeader, sizeof(blockHeader));
+            for (auto const & subBlock : subBlocks)
+            {
+                maniscalco::m99_sub_block_index_entry entry{.encodedSize_ = (std::uint32_t)subBlock.size()};
+                append(frame, &entry, sizeof(entry));
+            }
+            for (auto const & subBlock : subBlocks)
+            {
+                maniscalco::m99_checksum checksum = maniscalco::m99_crc32c(subBlock.data(), subBlock.size());
+                append(frame, &checksum, sizeof(checksum));
+            }
+            maniscalco::m99_checksum blockChecksum = maniscalco::m99_crc32c(blockBegin, blockSize);
+            append(frame, &blockChecksum, sizeof(blockChecksum));
+            for (auto const & subBlock : subBlocks)
+                frame += subBlock;
+        }
+
+        maniscalco::m99_block_header endOfFrame{};
+        append(frame, &endOfFrame, sizeof(endOfFrame));
+        maniscalco::m99_frame_trailer trailer
+        {
+            .indexPosition_ = frame.size(),
+            .decodedSize_ = input.size(),
+            .blockCount_ = (std::uint32_t)blockIndex.size(),
+            .magic_ = maniscalco::m99_frame_trailer_magic
+        };
+        append(frame, blockIndex.data(), blockIndex.size() * sizeof(maniscalco::m99_block_index_entry));
+        append(frame, &trailer, sizeof(trailer));
+        return frame;
+    }
+
+
+    //==================================================================================================================
+    bool decode_frame
+    (
+        // decodes the whole of a frame block by block as the m99 decoder does
+        std::string const & frame,
+        std::vector<std::uint8_t> & output
+    )
+    {
+        std::istringstream inStream(frame);
+        maniscalco::m99_frame_header frameHeader;
+        if ((!inStream.read((char *)&frameHeader, sizeof(frameHeader))) || (!maniscalco::m99_is_valid(frameHeader)))
+            return false;
+        maniscalco::m99_frame_limits limits{.maxBlockSize_ = frameHeader.maxBlockSize_,
+                .bytesRemaining_ = (frame.size() - sizeof(frameHeader))};
+        maniscalco::m99_buffer_pool bufferPool;
+        maniscalco::m99_encoded_block encodedBlock;
+        output.clear();
+        while (true)
+        {
+            if (!maniscalco::m99_read_block(inStream, limits, encodedBlock, bufferPool))
+                return false;
+            if (maniscalco::m99_is_end_of_frame(encodedBlock.header_))
+                return true;
+            auto offset = output.size();
+            output.resize(offset + encodedBlock.header_.blockSize_);
+            if (!maniscalco::m99_decode_block(encodedBlock, output.data() + offset, num_threads, bufferPool))
+                return false;
+        }
+    }
+
+
+    //==================================================================================================================
+    bool test_frame_round_trip
+    (
+        // a frame decodes to the original data and its block index locates every block
+        std::vector<std::uint8_t> const & input,
+        std::string const & frame
+    )
+    {
+        std::vector<std::uint8_t> decoded;
+        if ((!decode_frame(frame, decoded)) || (decoded != input))
+        {
+            std::cerr << "frame round trip: the frame did not decode to the original data\n";
+            return false;
+        }
+
+        std::istringstream inStream(frame);
+        std::vector<maniscalco::m99_block_location> blockLocations;
+        if (!maniscalco::m99_read_block_index(inStream, blockLocations))
+        {
+            std::cerr << "frame round trip: the block index was not read\n";
+            return false;
+        }
+        auto numBlocks = ((input.size() + block_size - 1) / block_size);
+        std::uint64_t decodedOffset = 0;
+        for (auto const & blockLocation : blockLocations)
+        {
+            if (blockLocation.decodedOffset_ != decodedOffset)
+                break;
+            decodedOffset += blockLocation.decodedSize_;
+        }
+        if ((blockLocations.size() != numBlocks) || (decodedOffset != input.size()))
+        {
+            std::cerr << "frame round trip: the block index does not cover the original data\n";
+            return false;
+        }
+        return true;
+    }
+
+
+    //==================================================================================================================
+    bool test_decode_range
+    (
+        // a range decoded via the block index is the same slice of the fully decoded frame.  a range beyond the
+        // data is rejected.
+        std::string const & frame
+    )
+    {
+        std::vector<std::uint8_t> decoded;
+        if (!decode_frame(frame, decoded))
+        {
+            std::cerr << "decode range: the frame did not decode\n";
+            return false;
+        }
+
+        std::istringstream inStream(frame);
+        std::vector<maniscalco::m99_block_location> blockLocations;
+        if (!maniscalco::m99_read_block_index(inStream, blockLocations))
+        {
+            std::cerr << "decode range: the block index was not read\n";
+            return false;
+        }
+
+        struct range_type
+        {
+            std::uint64_t offset_;
+            std::uint64_t length_;
+        };
+        maniscalco::m99_buffer_pool bufferPool;
+        for (auto [offset, length] : {range_type{0, 1}, range_type{0, input_size}, range_type{block_size - 10, 20},
+                range_type{block_size + 1, block_size + 100}, range_type{input_size - 1, 1}, range_type{1000, 0}})
+        {
+            std::vector<std::uint8_t> range(length);
+            if ((!maniscalco::m99_decode_range(inStream, blockLocations, offset, length, range.data(), num_threads, bufferPool)) ||
+                    (!std::equal(range.begin(), range.end(), decoded.begin() + offset)))
+            {
+                std::cerr << "decode range: [" << offset << ", " << (offset + length) << ") did not match the full decode\n";
+                return false;
+            }
+        }
+
+        std::vector<std::uint8_t> range(2);
+        if (maniscalco::m99_decode_range(inStream, blockLocations, input_size - 1, 2, range.data(), num_threads, bufferPool))
+        {
+            std::cerr << "decode range: a range beyond the data was accepted\n";
+            return false;
+        }
+        return true;
+    }
+
+} // namespace
+
+
+//======================================================================================================================
+int main
+(
+    int,
+    char const **
+)
+{
+    auto input = make_input();
+    auto frame = make_frame(input);
+    if (!test_frame_round_trip(input, frame))
+        return 1;
+    if (!test_decode_range(frame))
+        return 1;
+    std::cout << "m99_frame_test passed\n";
+    return 0;
+}
@@ -0,0 +1,186 @@
+#include <library/m99/m99_thread_pool.h>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+
+    static std::size_t constexpr num_workers = 4;
+    static std::size_t constexpr num_callers = 4;
+    static std::size_t constexpr outer_count = 8;
+    static std::size_t constexpr inner_count = 4;
+
+
+    //==================================================================================================================
+    // state shared by the threads of a test.  every change is made under the lock and wakes all waiters so a
+    // thread can wait for any condition on the state.  nothing is timed: a pool which fails to run a task leaves
+    // the test waiting (and the test's timeout reports it).
+    class shared_state
+    {
+    public:
+
+        void update
+        (
+            std::function<void()> change
+        )
+        {
+            {
+                std::lock_guard lockGuard(mutex_);
+                change();
+            }
+            changed_.notify_all();
+        }
+
+        void wait_for
+        (
+            std::function<bool()> predicate
+        )
+        {
+            std::unique_lock uniqueLock(mutex_);
+            changed_.wait(uniqueLock, predicate);
+        }
+
+    private:
+
+        std::mutex mutex_;
+
+        std::condition_variable changed_;
+
+    };
+
+
+    //==================================================================================================================
+    bool test_idle_worker_wakes
+    (
+        // a task submitted while an idle worker is asleep must wake that worker even when a thread waiting for a
+        // group is asleep as well (the wake up must not be spent on the waiter which can not take the task).
+    )
+    {
+        maniscalco::m99_thread_pool threadPool(2);
+        shared_state state;
+        std::size_t numClaimed = 0;
+        bool ownerDone = false;
+        bool release = false;
+
+        // both workers take a task of the group.  the first is held until the end of the test so only the second
+        // worker is left to take new tasks.  the second finishes once the group's owner has finished its own task
+        // and so is left with nothing to do while the owner waits for the group.  the order in which the two then
+        // go to sleep is up to the scheduler.  in either order the idle worker must take the next task.
+        std::thread owner([&]()
+                {
+                    auto ownerId = std::this_thread::get_id();
+                    threadPool.parallel_for(3, 3, [&](auto)
+                            {
+                                if (std::this_thread::get_id() == ownerId)
+                                {
+                                    state.wait_for([&](){return (numClaimed == 2);});
+                                    state.update([&](){ownerDone = true;});
+                                    return;
+                                }
+                                std::size_t claim = 0;
+                                state.update([&](){claim = numClaimed++;});
+                                if (claim == 0)
+                                    state.wait_for([&](){return release;});
+                                else
+                                    state.wait_for([&](){return ownerDone;});
+                            });
+                });
+        state.wait_for([&](){return ownerDone;});
+
+        // the caller holds the first index until the second has been started.  the caller is busy and the first
+        // worker is held so only the idle worker can start it.
+        auto callerId = std::this_thread::get_id();
+        bool workerRan = false;
+        threadPool.parallel_for(2, 2, [&](auto)
+                {
+                    if (std::this_thread::get_id() != callerId)
+                        state.update([&](){workerRan = true;});
+                    else
+                        state.wait_for([&](){return workerRan;});
+                });
+        state.update([&](){release = true;});
+        owner.join();
+
+        if (!workerRan)
+        {
+            std::cerr << "idle worker wake: the idle worker was not woken for a new task\n";
+            return false;
+        }
+        return true;
+    }
+
+
+    //==================================================================================================================
+    bool test_nested_parallel_for
+    (
+        // several external threads each run a parallel_for whose tasks run a parallel_for of their own (as the
+        // decoder does with sub blocks and their subtrees).  every index must run exactly once and the pool's
+        // workers (not just the callers) must take part.
+    )
+    {
+        maniscalco::m99_thread_pool threadPool(num_workers);
+        shared_state state;
+        std::size_t numCalls = 0;
+        std::set<std::thread::id> callerIds;
+        std::set<std::thread::id> workerIds;
+
+        // every inner task waits until two of the pool's workers have run one.  the callers alone can not satisfy
+        // that so the test completes only if the workers are woken for the callers' tasks.
+        auto callerFunction = [&]()
+                {
+                    state.update([&](){callerIds.insert(std::this_thread::get_id());});
+                    state.wait_for([&](){return (callerIds.size() == num_callers);});
+                    threadPool.parallel_for(outer_count, outer_count, [&](auto)
+                            {
+                                threadPool.parallel_for(inner_count, inner_count, [&](auto)
+                                        {
+                                            state.update([&]()
+                                                    {
+                                                        if (callerIds.count(std::this_thread::get_id()) == 0)
+                                                            workerIds.insert(std::this_thread::get_id());
+                                                        ++numCalls;
+                                                    });
+                                            state.wait_for([&](){return (workerIds.size() >= 2);});
+                                        });
+                            });
+                };
+
+        std::vector<std::thread> callers;
+        for (std::size_t i = 0; i < num_callers; ++i)
+            callers.emplace_back(callerFunction);
+        for (auto & caller : callers)
+            caller.join();
+
+        auto expected = (num_callers * outer_count * inner_count);
+        if (numCalls != expected)
+        {
+            std::cerr << "nested parallel_for: " << numCalls << " calls, expected " << expected << '\n';
+            return false;
+        }
+        return true;
+    }
+
+} // namespace
+
+
+//======================================================================================================================
+int main
+(
+    int,
+    char const **
+)
+{
+    if (!test_idle_worker_wakes())
+        return 1;
+    if (!test_nested_parallel_for())
+        return 1;
+    std::cout << "m99_thread_pool_test passed\n";
+    return 0;
+}